@@ -25,17 +25,22 @@
 \*----------------------------------------------------------------------------------*/
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
 #include <limits>
+#include <utility>
 #include <vector>
 
 #include "slot_map_algorithm.hpp"
+#include "slot_map_btree.hpp"
 #include "slot_map_moon.hpp"
 #include "empty_mutex.hpp"
 #include "generation_data.hpp"
 
 namespace std {
 
-template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Compare>
 struct basic_ordered_slot_map;
 
 namespace slot_internal {
@@ -55,33 +60,35 @@ struct basic_ordered_slot {
 
 }
 
-template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Compare>
 struct basic_ordered_slot_map_iterator;
-template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Compare>
 struct basic_ordered_slot_map_const_iterator;
-template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Compare>
 struct basic_ordered_slot_map_reverse_iterator;
-template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Compare>
 struct basic_ordered_slot_map_const_reverse_iterator;
 
 template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = std::allocator<T>,
-		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>>
 struct basic_ordered_slot_map_iterator {
 private:
-	typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::iterator itr;
+	typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::iterator itr;
 
-	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>;
 
-	friend struct basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
 
-	basic_ordered_slot_map_iterator(const typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::iterator& it)
+	basic_ordered_slot_map_iterator(const typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::iterator& it)
 		: itr(it)
 	{}
 public:
+	typedef std::bidirectional_iterator_tag iterator_category;
 	typedef T value_type;
 	typedef size_t size_type;
 	typedef ptrdiff_t difference_type;
@@ -134,35 +141,37 @@ public:
 		return itr >= rhs.itr;
 	}
 
-	inline operator basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator(itr));
+	inline operator basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator(itr));
 	}
-	inline operator basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator(itr));
+	inline operator basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator(itr));
 	}
-	inline operator basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator(itr));
+	inline operator basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator(itr));
 	}
 };
 
 template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = std::allocator<T>,
-		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>>
 struct basic_ordered_slot_map_const_iterator {
 private:
-	typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator itr;
+	typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator itr;
 
-	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>;
 
-	friend struct basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
 
-	basic_ordered_slot_map_const_iterator(const typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator& it)
+	basic_ordered_slot_map_const_iterator(const typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator& it)
 		: itr(it)
 	{}
 public:
+	typedef std::bidirectional_iterator_tag iterator_category;
 	typedef T value_type;
 	typedef size_t size_type;
 	typedef ptrdiff_t difference_type;
@@ -215,35 +224,37 @@ public:
 		return itr >= rhs.itr;
 	}
 
-	inline operator basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::iterator(itr));
+	inline operator basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::iterator(itr));
 	}
-	inline operator basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator(itr));
+	inline operator basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator(itr));
 	}
-	inline operator basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator(itr));
+	inline operator basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator(itr));
 	}
 };
 
 template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = std::allocator<T>,
-		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>>
 struct basic_ordered_slot_map_reverse_iterator {
 private:
-	typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator itr;
+	typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator itr;
 
-	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>;
 
-	friend struct basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
 
-	basic_ordered_slot_map_reverse_iterator(const typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator& it)
+	basic_ordered_slot_map_reverse_iterator(const typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator& it)
 		: itr(it)
 	{}
 public:
+	typedef std::bidirectional_iterator_tag iterator_category;
 	typedef T value_type;
 	typedef size_t size_type;
 	typedef ptrdiff_t difference_type;
@@ -296,35 +307,37 @@ public:
 		return itr >= rhs.itr;
 	}
 
-	inline operator basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::iterator(itr));
+	inline operator basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::iterator(itr));
 	}
-	inline operator basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator(itr));
+	inline operator basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator(itr));
 	}
-	inline operator basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator(itr));
+	inline operator basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator(itr));
 	}
 };
 
 template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = std::allocator<T>,
-		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>>
 struct basic_ordered_slot_map_const_reverse_iterator {
 private:
-	typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator itr;
+	typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator itr;
 
-	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>;
 
-	friend struct basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
 
-	basic_ordered_slot_map_const_reverse_iterator(const typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator& it)
+	basic_ordered_slot_map_const_reverse_iterator(const typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_reverse_iterator& it)
 		: itr(it)
 	{}
 public:
+	typedef std::bidirectional_iterator_tag iterator_category;
 	typedef T value_type;
 	typedef size_t size_type;
 	typedef ptrdiff_t difference_type;
@@ -377,20 +390,20 @@ public:
 		return itr >= rhs.itr;
 	}
 
-	inline operator basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::iterator(itr));
+	inline operator basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::iterator(itr));
 	}
-	inline operator basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator(itr));
+	inline operator basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::const_iterator(itr));
 	}
-	inline operator basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>() const {
-		return basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>(typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator(itr));
+	inline operator basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>() const {
+		return basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>(typename slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc>::reverse_iterator(itr));
 	}
 };
 
-template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Compare>
 struct basic_ordered_slot_map_weak_handle;
-template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Compare>
 struct basic_ordered_slot_map_handle;
 
 namespace slot_internal {
@@ -413,21 +426,23 @@ struct internal_basic_ordered_slot_map_handle {
 template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = std::allocator<T>,
-		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>>
 struct basic_ordered_slot_map_handle : slot_internal::internal_basic_ordered_slot_map_handle<Mut> {
 	basic_ordered_slot_map_handle() = default;
 
-	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>;
 
 	basic_ordered_slot_map_handle(const basic_ordered_slot_map_handle& rhs) {
-		new (this) slot_internal::internal_basic_ordered_slot_map_handle<Mut>((const slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs);
+		*this = (const slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
 	}
 	basic_ordered_slot_map_handle(basic_ordered_slot_map_handle&& rhs) {
-		new (this) slot_internal::internal_basic_ordered_slot_map_handle<Mut>(std::move((slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs));
+		*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+		rhs.clear();
 	}
 
 	basic_ordered_slot_map_handle(const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& rhs) {
-		if(rhs.moon && basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), false))
+		if(rhs.moon && basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), false))
 			*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
 	}
 	basic_ordered_slot_map_handle(slot_internal::internal_basic_ordered_slot_map_handle<Mut>&& rhs) {
@@ -449,7 +464,7 @@ struct basic_ordered_slot_map_handle : slot_internal::internal_basic_ordered_slo
 
 		this->~basic_ordered_slot_map_handle();
 
-		if(rhs.moon && basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), false))
+		if(rhs.moon && basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), false))
 			*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
 		return *this;
 	}
@@ -467,50 +482,52 @@ struct basic_ordered_slot_map_handle : slot_internal::internal_basic_ordered_slo
 
 	~basic_ordered_slot_map_handle() {
 		if(this->moon)
-			basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::decrement_handle_external(*this, false);
+			basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::decrement_handle_external(*this, false);
 		this->clear();
 	}
 
 	inline T& operator*() {
-		return *basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, false);
+		return *basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(*this, false);
 	}
 	inline T* operator->() {
-		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, false);
+		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(*this, false);
 	}
 
 	inline const T& operator*() const {
-		return const_cast<const T&>(*basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(*this), false));
+		return const_cast<const T&>(*basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(*this), false));
 	}
 	inline const T* operator->() const {
-		return const_cast<const T*>(basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(*this), false));
+		return const_cast<const T*>(basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(*this), false));
 	}
 
 	inline operator T*() {
-		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, false);
+		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(*this, false);
 	}
 	inline operator const T*() const {
-		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, false);
+		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(*this, false);
 	}
 };
 
 template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = std::allocator<T>,
-		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>>
 struct basic_ordered_slot_map_weak_handle : slot_internal::internal_basic_ordered_slot_map_handle<Mut> {
 	basic_ordered_slot_map_weak_handle() = default;
 
-	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>;
 
 	basic_ordered_slot_map_weak_handle(const basic_ordered_slot_map_weak_handle& rhs) {
-		new (this) slot_internal::internal_basic_ordered_slot_map_handle<Mut>((const slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs);
+		*this = (const slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
 	}
 	basic_ordered_slot_map_weak_handle(basic_ordered_slot_map_weak_handle&& rhs) {
-		new (this) slot_internal::internal_basic_ordered_slot_map_handle<Mut>(std::move((slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs));
+		*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+		rhs.clear();
 	}
 
 	basic_ordered_slot_map_weak_handle(const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& rhs) {
-		if(rhs.moon && basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), true))
+		if(rhs.moon && basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), true))
 			*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
 	}
 	basic_ordered_slot_map_weak_handle(slot_internal::internal_basic_ordered_slot_map_handle<Mut>&& rhs) {
@@ -532,7 +549,7 @@ struct basic_ordered_slot_map_weak_handle : slot_internal::internal_basic_ordere
 
 		this->~basic_ordered_slot_map_weak_handle();
 
-		if(rhs.moon && basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), true))
+		if(rhs.moon && basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), true))
 			*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
 		return *this;
 	}
@@ -550,29 +567,29 @@ struct basic_ordered_slot_map_weak_handle : slot_internal::internal_basic_ordere
 
 	~basic_ordered_slot_map_weak_handle() {
 		if(this->moon)
-			basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::decrement_handle_external(*this, true);
+			basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::decrement_handle_external(*this, true);
 		this->clear();
 	}
 
 	inline T& operator*() {
-		return *basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, true);
+		return *basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(*this, true);
 	}
 	inline T* operator->() {
-		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, true);
+		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(*this, true);
 	}
 
 	inline const T& operator*() const {
-		return const_cast<const T&>(*basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(*this), true));
+		return const_cast<const T&>(*basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(*this), true));
 	}
 	inline const T* operator->() const {
-		return const_cast<const T*>(basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(*this), true));
+		return const_cast<const T*>(basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(*this), true));
 	}
 
 	inline operator T*() {
-		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, true);
+		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(*this, true);
 	}
 	inline operator const T*() const {
-		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, true);
+		return basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>::get_object_external(*this, true);
 	}
 };
 
@@ -580,15 +597,20 @@ struct basic_ordered_slot_map_weak_handle : slot_internal::internal_basic_ordere
 template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = std::allocator<T>,
-		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>>
-struct basic_ordered_slot_map {
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>>
+struct basic_ordered_slot_map : private slot_internal::compare_holder<Compare> {
 private:
+	typedef slot_internal::btree_sequence<slot_internal::basic_ordered_slot<T>, Alloc> items_type;
+	typedef typename items_type::leaf_node items_leaf;
+
 	struct slot_index {
 		slot_internal::generation_data<uint32_t> gens;
 		union slot_data {
 			size_t next;								//used when object doesn't exist to reference the next object to allocate
-			size_t idx;									//index into items
+			items_leaf* leaf;							//leaf of items holding the object
 		} unn;
+		size_t idx;										//slot in the leaf storage (leaf->slots()), only changes when the object moves
 	};
 
 	typedef typename slot_internal::slot_map_moon<Mut> MoonType;
@@ -597,16 +619,16 @@ private:
 	MoonType* moon = 0;
 	slot_index* firstslot = 0;
 	slot_index* lastslot = 0;
-	std::vector<slot_internal::basic_ordered_slot<T>, Alloc> items;
+	items_type items;
 	std::vector<slot_index, Alloc> indexes;
 
-	friend struct basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare>;
 
-	friend struct basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>;
-	friend struct basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>;
+	friend struct basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>;
+	friend struct basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc, Compare>;
 
 	void extend(size_t extnd) {
 		if(extnd == 0)
@@ -679,11 +701,18 @@ public:
 		initMoon();
 		extend(slots);
 	}
-	basic_ordered_slot_map(const basic_ordered_slot_map& rhs) {
+	explicit basic_ordered_slot_map(const Compare& comp, size_t slots = 50)
+		: slot_internal::compare_holder<Compare>(comp) {
+		initMoon();
+		extend(slots);
+	}
+	basic_ordered_slot_map(const basic_ordered_slot_map& rhs)
+		: slot_internal::compare_holder<Compare>(rhs.get_compare()) {
 		initMoon();
 		*this = rhs;
 	}
-	basic_ordered_slot_map(basic_ordered_slot_map&& rhs) {
+	basic_ordered_slot_map(basic_ordered_slot_map&& rhs)
+		: slot_internal::compare_holder<Compare>(rhs.get_compare()) {
 		*this = std::move(rhs);
 	}
 
@@ -692,12 +721,14 @@ public:
 			return *this;
 
 		reset(false, false);
+		this->set_compare(rhs.get_compare());
 		return *this;
 	}
 	basic_ordered_slot_map& operator=(basic_ordered_slot_map&& rhs) {
 		if(this == &rhs)
 			return *this;
 		reset(false, true);
+		this->set_compare(rhs.get_compare());
 
 		count = std::move(rhs.count);
 		moon = std::move(rhs.moon);
@@ -705,16 +736,18 @@ public:
 		lastslot = std::move(rhs.lastslot);
 		items = std::move(rhs.items);
 		indexes = std::move(rhs.indexes);
+		if(moon)
+			moon->slot_map_ptr = this;
 
 		rhs.reset(true, true);
 		return *this;
 	}
 
 	template<typename A>
-	basic_ordered_slot_map clone(std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>, A>& out) {
+	basic_ordered_slot_map clone(std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>, A>& out) {
 		//go through all of the values in this, insert them into the rtn result
 		//return all of the handles to these values
-		basic_ordered_slot_map rtn;
+		basic_ordered_slot_map rtn(this->get_compare());
 		for(auto it = begin(); it != end(); ++it)
 			out.push_back(rtn.insert(*it));
 		return rtn;
@@ -736,24 +769,26 @@ public:
 	typedef T const& const_reference;
 	typedef T* pointer;
 	typedef T const* const_pointer;
-	typedef basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc> iterator;
-	typedef basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc> const_iterator;
-	typedef basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc> reverse_iterator;
-	typedef basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc> const_reverse_iterator;
-	typedef basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc> handle;
-	typedef basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc> weak_handle;
+	typedef basic_ordered_slot_map_iterator<T, Mut, Alloc, MoonAlloc, Compare> iterator;
+	typedef basic_ordered_slot_map_const_iterator<T, Mut, Alloc, MoonAlloc, Compare> const_iterator;
+	typedef basic_ordered_slot_map_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare> reverse_iterator;
+	typedef basic_ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, MoonAlloc, Compare> const_reverse_iterator;
+	typedef basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> handle;
+	typedef basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc, Compare> weak_handle;
+	typedef Compare key_compare;
+	typedef Compare value_compare;
 private:
 	void destruct_object(slot_index* obj) {
 		//remove object
 		obj->gens.set_invalid();
 
-		//remove this object
-		items.erase(items.begin() + obj->unn.idx);
-		//change all of the indexes to the displaced objects
-		for(size_t idx = obj->unn.idx; idx < items.size(); ++idx)
-			indexes[items[idx].backidx].unn.idx = idx;
+		//remove this object, only the objects between it and the nearer end of its leaf move
+		erase_item(obj->unn.leaf, obj->idx - obj->unn.leaf->first);
 
-		obj->unn.idx = 0;
+		free_index(obj);
+	}
+	void free_index(slot_index* obj) {
+		obj->idx = 0;
 
 		//add to the start of the free list
 		if(firstslot == 0) {
@@ -837,9 +872,9 @@ public:
 
 	// capacity:
 	inline size_type size() const noexcept {
-		const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>*>(this)->lock();
+		const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->lock();
 		size_type rtn = count;
-		const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>*>(this)->unlock();
+		const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->unlock();
 		return rtn;
 	}
 	inline size_type max_size() const noexcept {
@@ -856,9 +891,9 @@ public:
 	}
 	inline size_type capacity() const noexcept {
 		//returns the smaller of the two
-		const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>*>(this)->lock();
+		const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->lock();
 		size_type rtn = items.capacity();
-		const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>*>(this)->unlock();
+		const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->unlock();
 		return rtn;
 	}
 	void reserve(size_type n) {
@@ -878,77 +913,89 @@ public:
 	}
 
 private:
-	void update_object_indexes(size_t pos) {
-		for(size_t i = pos + 1; i < items.size(); ++i)
-			indexes[items[i].backidx].unn.idx = i;
-	}
-	size_t get_insert_pos(const T& val) {
-		//search and insert this, returning the position
-		typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::iterator out;
-		slot_internal::binary_search(items.begin(), items.end(), (const T&)val,
-			[](const T& lhs, const T& rhs){
-				return lhs < rhs;
-			}, out);
-
-		size_t pos = std::distance(items.begin(), out);
+	void update_object_indexes(items_leaf* lf, size_t pos, size_t last) {
+		slot_internal::basic_ordered_slot<T>* vals = lf->values();
+		for(size_t i = pos; i < last; ++i) {
+			slot_index& rf = indexes[vals[i].backidx];
+			rf.unn.leaf = lf;
+			rf.idx = lf->first + i;
+		}
+	}
+	inline void update_object_indexes(items_leaf* lf, size_t pos) {
+		update_object_indexes(lf, pos, lf->count);
+	}
+	void update_object_indexes(items_leaf* lf, items_leaf* nxt, const typename items_type::iterator& it) {
+		//lf and nxt were the target leaf and its neighbour before the insert, a split moves the upper half into a new leaf
+		if(it.lf != lf)
+			update_object_indexes(it.lf, 0);
+		else {
+			update_object_indexes(lf, items.moved_first, items.moved_last);
+			if(lf->next != nxt)
+				update_object_indexes(lf->next, 0);
+		}
+	}
+	void erase_item(items_leaf* lf, size_t pos) {
+		//erase the value at pos in lf and fix the indexes of the values the erase moved, a small leaf can be merged into
+		//or take values from a neighbour so they may now be in another leaf
+		items.erase(typename items_type::iterator(&items, lf, pos));
+		if(items.moved_leaf)
+			update_object_indexes(items.moved_leaf, items.moved_first, items.moved_last);
+	}
+	void get_insert_pos(const T& val, size_t backidx) {
+		//search and insert this
+		typename items_type::iterator out = lower_bound_internal((const T&)val, this->get_compare());
+
+		items_leaf* lf = out.lf ? out.lf : items.tail;
+		items_leaf* nxt = lf ? lf->next : 0;
 		slot_internal::basic_ordered_slot<T> itm;
+		itm.backidx = backidx;
 		itm.obj = val;
-		items.insert(out, std::move(itm));
 
-		//change all of the object indexes for move from insert
-		update_object_indexes(pos);
-		return pos;
+		//change the object indexes for the objects moved by the insert
+		update_object_indexes(lf, nxt, items.insert(out, std::move(itm)));
 	}
 	template<typename Less>
-	size_t get_insert_pos(const T& val, Less comp) {
-		//search and insert this, returning the position
-		typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::iterator out;
-		slot_internal::binary_search(items.begin(), items.end(), (const T&)val,
-									 comp, out);
+	void get_insert_pos(const T& val, size_t backidx, Less comp) {
+		//search and insert this
+		typename items_type::iterator out = lower_bound_internal((const T&)val, comp);
 
-		size_t pos = std::distance(items.begin(), out);
+		items_leaf* lf = out.lf ? out.lf : items.tail;
+		items_leaf* nxt = lf ? lf->next : 0;
 		slot_internal::basic_ordered_slot<T> itm;
+		itm.backidx = backidx;
 		itm.obj = val;
-		items.insert(out, std::move(itm));
 
-		//change all of the object indexes for move from insert
-		update_object_indexes(pos);
-		return pos;
+		//change the object indexes for the objects moved by the insert
+		update_object_indexes(lf, nxt, items.insert(out, std::move(itm)));
 	}
-	size_t get_insert_pos(T&& val) {
-		//search and insert this, returning the position
-		typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::iterator out;
-		slot_internal::binary_search(items.begin(), items.end(), (const T&)val,
-			[](const T& lhs, const T& rhs){
-				return lhs < rhs;
-			}, out);
+	void get_insert_pos(T&& val, size_t backidx) {
+		//search and insert this
+		typename items_type::iterator out = lower_bound_internal((const T&)val, this->get_compare());
 
-		size_t pos = std::distance(items.begin(), out);
+		items_leaf* lf = out.lf ? out.lf : items.tail;
+		items_leaf* nxt = lf ? lf->next : 0;
 		slot_internal::basic_ordered_slot<T> itm;
+		itm.backidx = backidx;
 		itm.obj = std::move(val);
-		items.insert(out, std::move(itm));
 
-		//change all of the object indexes for move from insert
-		update_object_indexes(pos);
-		return pos;
+		//change the object indexes for the objects moved by the insert
+		update_object_indexes(lf, nxt, items.insert(out, std::move(itm)));
 	}
 	template<typename Less>
-	size_t get_insert_pos(T&& val, Less comp) {
-		//search and insert this, returning the position
-		typename std::vector<slot_internal::basic_ordered_slot<T>, Alloc>::iterator out;
-		slot_internal::binary_search(items.begin(), items.end(), (const T&)val,
-									 comp, out);
+	void get_insert_pos(T&& val, size_t backidx, Less comp) {
+		//search and insert this
+		typename items_type::iterator out = lower_bound_internal((const T&)val, comp);
 
-		size_t pos = std::distance(items.begin(), out);
+		items_leaf* lf = out.lf ? out.lf : items.tail;
+		items_leaf* nxt = lf ? lf->next : 0;
 		slot_internal::basic_ordered_slot<T> itm;
+		itm.backidx = backidx;
 		itm.obj = std::move(val);
-		items.insert(out, std::move(itm));
 
-		//change all of the object indexes for move from insert
-		update_object_indexes(pos);
-		return pos;
+		//change the object indexes for the objects moved by the insert
+		update_object_indexes(lf, nxt, items.insert(out, std::move(itm)));
 	}
-	size_t get_next_free(size_t nidx) {
+	size_t get_next_free() {
 		if(count == indexes.size())
 			//double the size
 			extend(indexes.size());
@@ -966,18 +1013,63 @@ private:
 			firstslot = nxt;
 
 		++count;
-		indexes[pos].unn.idx = nidx;
 		return pos;
 	}
+	template<typename Itr, typename Less>
+	std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>> insert_batch(Itr begin, Itr end, Less comp) {
+		//take the slots and handles first, in the order given
+		std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>> rtn;
+		std::vector<slot_internal::basic_ordered_slot<T>> batch;
+		for(; begin != end; ++begin) {
+			slot_internal::basic_ordered_slot<T> itm;
+			itm.backidx = get_next_free();
+			itm.obj = *begin;
+
+			basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> hdl;
+			hdl.moon = moon;
+			hdl.idx = itm.backidx;
+			hdl.gen = indexes[itm.backidx].gens.new_generation();
+			++moon->count;
+
+			batch.push_back(std::move(itm));
+			rtn.push_back(std::move(hdl));
+		}
+
+		if(batch.size() * 32 < items.size()) {
+			//small batch, cheaper to insert one by one
+			for(auto it = batch.begin(); it != batch.end(); ++it)
+				get_insert_pos(std::move(it->obj), it->backidx, comp);
+			return rtn;
+		}
+
+		//sort the batch, merge it with items in one pass and rebuild the tree
+		//equal objects end up where inserting them one by one puts them: a single insert goes in front of the objects
+		//equal to it, so the later of two equal batch objects comes first and the batch comes before equal items
+		auto slot_comp = [&comp](const slot_internal::basic_ordered_slot<T>& lhs, const slot_internal::basic_ordered_slot<T>& rhs) {
+			return comp(lhs.obj, rhs.obj);
+		};
+		std::reverse(batch.begin(), batch.end());
+		std::stable_sort(batch.begin(), batch.end(), slot_comp);
+
+		std::vector<slot_internal::basic_ordered_slot<T>> merged;
+		merged.reserve(items.size() + batch.size());
+		std::merge(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()),
+				   std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()),
+				   std::back_inserter(merged), slot_comp);
+		items.assign(std::make_move_iterator(merged.begin()), std::make_move_iterator(merged.end()));
+
+		//one pass over the leaves for the indexes
+		for(items_leaf* lf = items.head; lf != 0; lf = lf->next)
+			update_object_indexes(lf, 0);
+		return rtn;
+	}
 public:
-	basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc> insert(const T& val) {
+	basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> insert(const T& val) {
 		lock();
-		size_t idx = get_insert_pos(val);
-		size_t itemPos = get_next_free(idx);
-
-		items[idx].backidx = itemPos;
+		size_t itemPos = get_next_free();
+		get_insert_pos(val, itemPos);
 
-		basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc> rtn;
+		basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> rtn;
 		rtn.moon = moon;
 		rtn.idx = itemPos;
 		rtn.gen = indexes[itemPos].gens.new_generation();
@@ -987,14 +1079,12 @@ public:
 		return rtn;
 	}
 	template<typename Less>
-	basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc> insert(const T& val, Less comp) {
+	basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> insert(const T& val, Less comp) {
 		lock();
-		size_t idx = get_insert_pos(val, comp);
-		size_t itemPos = get_next_free(idx);
+		size_t itemPos = get_next_free();
+		get_insert_pos(val, itemPos, comp);
 
-		items[idx].backidx = itemPos;
-
-		basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc> rtn;
+		basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> rtn;
 		rtn.moon = moon;
 		rtn.idx = itemPos;
 		rtn.gen = indexes[itemPos].gens.new_generation();
@@ -1003,14 +1093,12 @@ public:
 		unlock();
 		return rtn;
 	}
-	basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc> insert(T&& val) {
+	basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> insert(T&& val) {
 		lock();
-		size_t idx = get_insert_pos(std::move(val));
-		size_t itemPos = get_next_free(idx);
-
-		items[idx].backidx = itemPos;
+		size_t itemPos = get_next_free();
+		get_insert_pos(std::move(val), itemPos);
 
-		basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc> rtn;
+		basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> rtn;
 		rtn.moon = moon;
 		rtn.idx = itemPos;
 		rtn.gen = indexes[itemPos].gens.new_generation();
@@ -1020,14 +1108,12 @@ public:
 		return rtn;
 	}
 	template<typename Less>
-	basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc> insert(T&& val, Less comp) {
+	basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> insert(T&& val, Less comp) {
 		lock();
-		size_t idx = get_insert_pos(std::move(val), comp);
-		size_t itemPos = get_next_free(idx);
+		size_t itemPos = get_next_free();
+		get_insert_pos(std::move(val), itemPos, comp);
 
-		items[idx].backidx = itemPos;
-
-		basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc> rtn;
+		basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare> rtn;
 		rtn.moon = moon;
 		rtn.idx = itemPos;
 		rtn.gen = indexes[itemPos].gens.new_generation();
@@ -1036,25 +1122,225 @@ public:
 		unlock();
 		return rtn;
 	}
+	//objects equal to each other or to ones already in the map are placed exactly where inserting them one by one would
 	template<typename Itr>
-	std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>> insert(Itr begin, Itr end) {
+	std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>> insert(Itr begin, Itr end) {
 		lock();
-		std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>> rtn;
-		for(; begin != end; ++begin)
-			rtn.push_back(insert(*begin));
+		std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>> rtn = insert_batch(begin, end, this->get_compare());
 		unlock();
 		return rtn;
 	}
 	template<typename Itr, typename Less>
-	std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>> insert(Itr begin, Itr end, Less comp) {
+	std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>> insert(Itr begin, Itr end, Less comp) {
+		lock();
+		std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>> rtn = insert_batch(begin, end, comp);
+		unlock();
+		return rtn;
+	}
+
+private:
+	template<typename U, typename Less>
+	typename items_type::iterator lower_bound_internal(const U& val, Less comp) {
+		return slot_internal::sequence_lower_bound(items, val,
+			[&comp](const slot_internal::basic_ordered_slot<T>& lhs, const U& rhs) {
+				return comp(lhs.obj, rhs);
+			});
+	}
+	template<typename U, typename Less>
+	typename items_type::iterator upper_bound_internal(const U& val, Less comp) {
+		//first item the value is less than
+		return slot_internal::sequence_lower_bound(items, val,
+			[&comp](const slot_internal::basic_ordered_slot<T>& lhs, const U& rhs) {
+				return !comp(rhs, lhs.obj);
+			});
+	}
+	template<typename U, typename Less>
+	typename items_type::iterator find_internal(const U& val, Less comp) {
+		typename items_type::iterator rtn = lower_bound_internal(val, comp);
+		if(rtn != items.end() && comp(val, rtn->obj))
+			return items.end();
+		return rtn;
+	}
+public:
+	// lookup:
+	//the Less overloads must order the items the same way as the stored Compare
+	iterator lower_bound(const T& val) {
+		return lower_bound(val, this->get_compare());
+	}
+	template<typename Less>
+	iterator lower_bound(const T& val, Less comp) {
+		lock();
+		iterator rtn(lower_bound_internal(val, comp));
+		unlock();
+		return rtn;
+	}
+	iterator upper_bound(const T& val) {
+		return upper_bound(val, this->get_compare());
+	}
+	template<typename Less>
+	iterator upper_bound(const T& val, Less comp) {
+		lock();
+		iterator rtn(upper_bound_internal(val, comp));
+		unlock();
+		return rtn;
+	}
+	std::pair<iterator, iterator> equal_range(const T& val) {
+		return equal_range(val, this->get_compare());
+	}
+	template<typename Less>
+	std::pair<iterator, iterator> equal_range(const T& val, Less comp) {
+		lock();
+		std::pair<iterator, iterator> rtn(iterator(lower_bound_internal(val, comp)), iterator(upper_bound_internal(val, comp)));
+		unlock();
+		return rtn;
+	}
+	iterator find(const T& val) {
+		return find(val, this->get_compare());
+	}
+	template<typename Less>
+	iterator find(const T& val, Less comp) {
+		lock();
+		iterator rtn(find_internal(val, comp));
+		unlock();
+		return rtn;
+	}
+
+	inline const_iterator lower_bound(const T& val) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->lower_bound(val);
+	}
+	template<typename Less>
+	inline const_iterator lower_bound(const T& val, Less comp) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->lower_bound(val, comp);
+	}
+	inline const_iterator upper_bound(const T& val) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->upper_bound(val);
+	}
+	template<typename Less>
+	inline const_iterator upper_bound(const T& val, Less comp) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->upper_bound(val, comp);
+	}
+	inline std::pair<const_iterator, const_iterator> equal_range(const T& val) const {
+		std::pair<iterator, iterator> rtn = const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->equal_range(val);
+		return std::pair<const_iterator, const_iterator>(rtn.first, rtn.second);
+	}
+	template<typename Less>
+	inline std::pair<const_iterator, const_iterator> equal_range(const T& val, Less comp) const {
+		std::pair<iterator, iterator> rtn = const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->equal_range(val, comp);
+		return std::pair<const_iterator, const_iterator>(rtn.first, rtn.second);
+	}
+	inline const_iterator find(const T& val) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->find(val);
+	}
+	template<typename Less>
+	inline const_iterator find(const T& val, Less comp) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->find(val, comp);
+	}
+
+	//heterogeneous lookup by a key, like std::set with std::less<>, no temporary T is built for the probes
+	//Less must declare is_transparent, accept (T, K) and (K, T) and order the keys like the items were inserted
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	iterator lower_bound(const K& key, Less comp) {
+		lock();
+		iterator rtn(lower_bound_internal(key, comp));
+		unlock();
+		return rtn;
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	iterator upper_bound(const K& key, Less comp) {
+		lock();
+		iterator rtn(upper_bound_internal(key, comp));
+		unlock();
+		return rtn;
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	std::pair<iterator, iterator> equal_range(const K& key, Less comp) {
 		lock();
-		std::vector<basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>> rtn;
-		for(; begin != end; ++begin)
-			rtn.push_back(insert(*begin, comp));
+		std::pair<iterator, iterator> rtn(iterator(lower_bound_internal(key, comp)), iterator(upper_bound_internal(key, comp)));
+		unlock();
+		return rtn;
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	iterator find(const K& key, Less comp) {
+		lock();
+		iterator rtn(find_internal(key, comp));
 		unlock();
 		return rtn;
 	}
 
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	inline const_iterator lower_bound(const K& key, Less comp) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->lower_bound(key, comp);
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	inline const_iterator upper_bound(const K& key, Less comp) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->upper_bound(key, comp);
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	inline std::pair<const_iterator, const_iterator> equal_range(const K& key, Less comp) const {
+		std::pair<iterator, iterator> rtn = const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->equal_range(key, comp);
+		return std::pair<const_iterator, const_iterator>(rtn.first, rtn.second);
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	inline const_iterator find(const K& key, Less comp) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->find(key, comp);
+	}
+
+	//heterogeneous lookup with the stored comparison, only when Compare is transparent
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline iterator lower_bound(const K& key) {
+		return lower_bound(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline iterator upper_bound(const K& key) {
+		return upper_bound(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline std::pair<iterator, iterator> equal_range(const K& key) {
+		return equal_range(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline iterator find(const K& key) {
+		return find(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline const_iterator lower_bound(const K& key) const {
+		return lower_bound(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline const_iterator upper_bound(const K& key) const {
+		return upper_bound(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+		return equal_range(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline const_iterator find(const K& key) const {
+		return find(key, this->get_compare());
+	}
+
+	inline Compare key_comp() const {
+		return this->get_compare();
+	}
+	inline Compare value_comp() const {
+		return this->get_compare();
+	}
+
+	//replace the stored comparison and re-sort every item in one pass, handles stay valid
+	void resort(const Compare& comp) {
+		lock();
+		this->set_compare(comp);
+		std::vector<slot_internal::basic_ordered_slot<T>> sorted(std::make_move_iterator(items.begin()), std::make_move_iterator(items.end()));
+		std::stable_sort(sorted.begin(), sorted.end(),
+			[&comp](const slot_internal::basic_ordered_slot<T>& lhs, const slot_internal::basic_ordered_slot<T>& rhs) {
+				return comp(lhs.obj, rhs.obj);
+			});
+		items.assign(std::make_move_iterator(sorted.begin()), std::make_move_iterator(sorted.end()));
+		for(items_leaf* lf = items.head; lf != 0; lf = lf->next)
+			update_object_indexes(lf, 0);
+		unlock();
+	}
+
 private:
 	slot_index* get_object_internal(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
 		slot_index& rf = indexes[hdl.idx];
@@ -1073,13 +1359,13 @@ private:
 	T* get_object(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
 		slot_index* obj = get_object_internal(hdl, weak);
 		if(obj)
-			return &items[obj->unn.idx].obj;
+			return &obj->unn.leaf->slots()[obj->idx].obj;
 		return 0;
 	}
 	const T* get_object(const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
 		slot_index* obj = get_object_internal(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(hdl), weak);
 		if(obj)
-			return &items[obj->unn.idx].obj;
+			return &obj->unn.leaf->slots()[obj->idx].obj;
 		return 0;
 	}
 
@@ -1088,9 +1374,66 @@ private:
 		if(obj)
 			destruct_object(obj);
 	}
+	size_t rank(const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_index* obj = get_object_internal(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(hdl), weak);
+		if(obj == 0)
+			return items.size();
+		return items.position(obj->unn.leaf, obj->idx - obj->unn.leaf->first);
+	}
+	template<typename Fn>
+	bool modify(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak, Fn& fn) {
+		slot_index* obj = get_object_internal(hdl, weak);
+		if(obj == 0)
+			return false;
+
+		items_leaf* lf = obj->unn.leaf;
+		size_t pos = obj->idx - lf->first;
+		slot_internal::basic_ordered_slot<T>* vals = lf->values();
+		fn(vals[pos].obj);
+
+		//still in order with its neighbours, nothing moves
+		const Compare& comp = this->get_compare();
+		typename items_type::iterator it(&items, lf, pos);
+		typename items_type::iterator prv = it;
+		typename items_type::iterator nxt = it;
+		bool left = it != items.begin() && comp(vals[pos].obj, (--prv)->obj);
+		bool right = !left && ++nxt != items.end() && comp(nxt->obj, vals[pos].obj);
+		if(!left && !right)
+			return true;
+
+		//new position inside this leaf, rotate only the values between the old and new position
+		size_t first = lf->count;
+		size_t last = 0;
+		if(left && pos > 0 && !comp(vals[pos].obj, vals[0].obj)) {
+			first = std::upper_bound(vals, vals + pos, vals[pos],
+				[&comp](const slot_internal::basic_ordered_slot<T>& lhs, const slot_internal::basic_ordered_slot<T>& rhs) {
+					return comp(lhs.obj, rhs.obj);
+				}) - vals;
+			last = pos;
+			std::rotate(vals + first, vals + pos, vals + pos + 1);
+		} else if(right && pos + 1 < lf->count && !comp(vals[lf->count - 1].obj, vals[pos].obj)) {
+			first = pos;
+			last = std::lower_bound(vals + pos + 1, vals + lf->count, vals[pos],
+				[&comp](const slot_internal::basic_ordered_slot<T>& lhs, const slot_internal::basic_ordered_slot<T>& rhs) {
+					return comp(lhs.obj, rhs.obj);
+				}) - vals - 1;
+			std::rotate(vals + pos, vals + pos + 1, vals + last + 1);
+		}
+		if(first <= last) {
+			update_object_indexes(lf, first, last + 1);
+			return true;
+		}
+
+		//moves to another leaf, take it out and insert it again
+		size_t backidx = vals[pos].backidx;
+		T val(std::move(vals[pos].obj));
+		erase_item(lf, pos);
+		get_insert_pos(std::move(val), backidx);
+		return true;
+	}
 public:
 
-	inline bool is_valid(const basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	inline bool is_valid(const basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
 		if(hdl.moon != moon)
 			return false;
 		lock();
@@ -1098,7 +1441,7 @@ public:
 		unlock();
 		return rtn;
 	}
-	inline bool is_valid(const basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	inline bool is_valid(const basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
 		if(hdl.moon != moon)
 			return false;
 		lock();
@@ -1106,7 +1449,7 @@ public:
 		unlock();
 		return rtn;
 	}
-	inline T* get_object(basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	inline T* get_object(basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
 		if(hdl.moon != moon)
 			return 0;
 		lock();
@@ -1114,7 +1457,7 @@ public:
 		unlock();
 		return rtn;
 	}
-	inline T* get_object(basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	inline T* get_object(basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
 		if(hdl.moon != moon)
 			return 0;
 		lock();
@@ -1122,7 +1465,7 @@ public:
 		unlock();
 		return rtn;
 	}
-	inline const T* get_object(const basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	inline const T* get_object(const basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
 		if(hdl.moon != moon)
 			return 0;
 		lock();
@@ -1130,7 +1473,7 @@ public:
 		unlock();
 		return rtn;
 	}
-	inline const T* get_object(const basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	inline const T* get_object(const basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
 		if(hdl.moon != moon)
 			return 0;
 		lock();
@@ -1139,14 +1482,14 @@ public:
 		return rtn;
 	}
 
-	inline void erase(basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	inline void erase(basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
 		if(hdl.moon != moon)
 			return;
 		lock();
 		erase(hdl, false);
 		unlock();
 	}
-	inline void erase(basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	inline void erase(basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
 		if(hdl.moon != moon)
 			return;
 		lock();
@@ -1154,13 +1497,83 @@ public:
 		unlock();
 	}
 
+	//change an object through its handle, fn(T&) may change the sort key, the object is then moved to its new position
+	//moves inside one leaf only shift the values between the old and new position, handles stay valid
+	//returns false if the handle is invalid
+	template<typename Fn>
+	inline bool modify(basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl, Fn fn) {
+		if(hdl.moon != moon)
+			return false;
+		lock();
+		bool rtn = modify(hdl, false, fn);
+		unlock();
+		return rtn;
+	}
+	template<typename Fn>
+	inline bool modify(basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl, Fn fn) {
+		if(hdl.moon != moon)
+			return false;
+		lock();
+		bool rtn = modify(hdl, true, fn);
+		unlock();
+		return rtn;
+	}
+
+	//position of an object in the sorted order (0 is the smallest), size() if the handle is invalid
+	//the counts of the b+tree are summed from the object's leaf to the root, O(log n)
+	inline size_t rank(const basic_ordered_slot_map_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
+		lock();
+		size_t rtn = hdl.moon == moon ? rank(hdl, false) : items.size();
+		unlock();
+		return rtn;
+	}
+	inline size_t rank(const basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc, Compare>& hdl) {
+		lock();
+		size_t rtn = hdl.moon == moon ? rank(hdl, true) : items.size();
+		unlock();
+		return rtn;
+	}
+	//the object at position pos in the sorted order, end() if pos >= size(), O(log n)
+	iterator nth(size_t pos) {
+		lock();
+		iterator rtn(items.iterator_at(pos));
+		unlock();
+		return rtn;
+	}
+	inline const_iterator nth(size_t pos) const {
+		return const_cast<basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*>(this)->nth(pos);
+	}
+
+	template<typename Pred>
+	size_t erase_if(Pred pred) {
+		lock();
+		//one sweep over items, kept objects are compacted and the tree rebuilt once
+		size_t rtn = 0;
+		std::vector<slot_internal::basic_ordered_slot<T>> kept;
+		kept.reserve(items.size());
+		for(auto it = items.begin(); it != items.end(); ++it) {
+			if(pred((const T&)it->obj)) {
+				slot_index* obj = &indexes[it->backidx];
+				obj->gens.set_invalid();
+				free_index(obj);
+				++rtn;
+			} else
+				kept.push_back(std::move(*it));
+		}
+		items.assign(std::make_move_iterator(kept.begin()), std::make_move_iterator(kept.end()));
+		for(items_leaf* lf = items.head; lf != 0; lf = lf->next)
+			update_object_indexes(lf, 0);
+		unlock();
+		return rtn;
+	}
+
 	void clear() noexcept {
 		lock();
 		//just clear the data, erase everything
 		size_t i = 0;
 		for(auto it = indexes.begin(); it != indexes.end(); ++it, ++i) {
 			if(it->gens.is_valid()) {
-				basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc> hdl;
+				basic_ordered_slot_map_weak_handle<T, Mut, Alloc, MoonAlloc, Compare> hdl;
 				hdl.moon = moon;
 				hdl.idx = std::distance(indexes.begin(), it);
 				hdl.gen = it->gens.increment_generation(true);
@@ -1203,7 +1616,7 @@ public:
 		unlock();
 	}
 private:
-	static basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>* getMap(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl) {
+	static basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>* getMap(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl) {
 		//get the map and lock this
 		if(hdl.moon == 0)
 			return 0;
@@ -1225,10 +1638,10 @@ private:
 			hdl.clear();
 			return 0;
 		}
-		return (basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>*)hdl.moon->slot_map_ptr;
+		return (basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>*)hdl.moon->slot_map_ptr;
 	}
 	static bool increment_handle_external(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
-		basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>* map = getMap(hdl);
+		basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>* map = getMap(hdl);
 		if(map == 0)
 			return false;
 		++hdl.moon->count;
@@ -1237,7 +1650,7 @@ private:
 		return rtn;
 	}
 	static void decrement_handle_external(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
-		basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>* map = getMap(hdl);
+		basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>* map = getMap(hdl);
 		if(map == 0)
 			return;
 		--hdl.moon->count;
@@ -1245,12 +1658,12 @@ private:
 		map->unlock();
 	}
 	static T* get_object_external(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
-		basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc>* map = getMap(hdl);
+		basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>* map = getMap(hdl);
 		if(map == 0)
 			return 0;
-		lock();
-		const T* rtn = map->get_object(hdl, weak);
-		unlock();
+		//getMap returns the map locked
+		T* rtn = map->get_object(hdl, weak);
+		map->unlock();
 		return rtn;
 	}
 
@@ -1260,4 +1673,9 @@ public:
 	}
 };
 
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Compare, typename Pred>
+inline size_t erase_if(basic_ordered_slot_map<T, Mut, Alloc, MoonAlloc, Compare>& map, Pred pred) {
+	return map.erase_if(pred);
+}
+
 }
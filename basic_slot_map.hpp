@@ -26,7 +26,9 @@
 #pragma once
 
 #include <limits>
+#include <type_traits>
 #include <vector>
+#include <string.h>
 
 #include "slot_map_moon.hpp"
 #include "empty_mutex.hpp"
@@ -47,7 +49,7 @@ struct basic_slot {
 
 	basic_slot() = default;
 	basic_slot(basic_slot&& rhs) {
-		valid = std::move(valid);
+		valid = rhs.valid;
 		if(valid)
 			new ((T*)obj) T(*(T*)rhs.obj);
 
@@ -625,11 +627,48 @@ public:
 
 	template<typename A>
 	basic_slot_map clone(std::vector<basic_slot_map_handle<T, Mut, Alloc, MoonAlloc>, A>& out) {
-		//go through all of the values in this, insert them into the rtn result
-		//return all of the handles to these values
-		basic_slot_map rtn;
-		for(auto it = begin(); it != end(); ++it)
-			out.push_back(rtn.insert(*it));
+		//copy the item array in one go (memcpy for trivially copyable T), every object keeps its item and index position
+		//the clone's indexes only count the returned handles, an index no object uses is free in the clone
+		//return all of the handles to these values, in iteration order
+		lock();
+		basic_slot_map rtn(0);
+		size_t sze = items.size();
+		rtn.items.resize(sze);
+		rtn.idxs.resize(sze);
+		if(sze > 0 && std::is_trivially_copyable<T>::value)
+			memcpy((void*)&rtn.items[0], (const void*)&items[0], sizeof(slot_internal::basic_slot<T>) * sze);
+		else
+			for(size_t i = 0; i < sze; ++i)
+				if(items[i].valid) {
+					new (rtn.items[i].obj) T(*(const T*)items[i].obj);
+					rtn.items[i].valid = true;
+				}
+
+		//the index of each object
+		std::vector<size_t> owner(sze, basic_slot_map_invalid);
+		for(size_t i = 0; i < sze; ++i) {
+			const slot_ref& rf = idxs[i];
+			if(rf.count > 0 && rf.idx != basic_slot_map_invalid && items[rf.idx].valid && owner[rf.idx] == basic_slot_map_invalid)
+				owner[rf.idx] = i;
+		}
+		out.reserve(out.size() + itemcount);
+		for(size_t i = 0; i < sze; ++i)
+			if(items[i].valid) {
+				rtn.idxs[owner[i]].count = 1;
+				rtn.idxs[owner[i]].idx = i;
+
+				out.emplace_back();
+				out.back().moon = rtn.moon;
+				out.back().idx = owner[i];
+				++rtn.idxcount;
+			}
+		rtn.itemcount = itemcount;
+		rtn.moon->count += rtn.idxcount;
+
+		//first free item and index, when full the next insert grows the map and sets them
+		for(; rtn.nextitem < sze && rtn.items[rtn.nextitem].valid; ++rtn.nextitem);
+		for(; rtn.nextidx < sze && rtn.idxs[rtn.nextidx].count > 0; ++rtn.nextidx);
+		unlock();
 		return rtn;
 	}
 
@@ -795,6 +834,10 @@ private:
 		++itemcount;
 		++idxcount;
 
+		//full, the next call resizes and resets the next positions
+		if(idxcount == idxs.size())
+			return;
+
 		//get the next item and index
 		do {
 			++nextitem;
@@ -926,15 +969,38 @@ public:
 			((T*)obj->obj)->~T();
 			--itemcount;
 
-			//clear the handle too
+			//clear the handle too, the index no longer points at the slot so other handles to it don't see a reused slot
 			slot_ref& rf = idxs[hdl.idx];
 			hdl.clear();
+			rf.idx = basic_slot_map_invalid;
 			--rf.count;
 			if(rf.count == 0) --idxcount;
 		}
 		unlock();
 	}
 
+	template<typename Pred>
+	size_t erase_if(Pred pred) {
+		lock();
+		//one sweep over the indexes, the index of an erased object is invalidated so its slot can be reused safely
+		//indexes no handle uses are skipped, their slot may belong to another index by now
+		size_t rtn = 0;
+		for(auto it = idxs.begin(); it != idxs.end(); ++it) {
+			if(it->count == 0 || it->idx == basic_slot_map_invalid)
+				continue;
+			slot_internal::basic_slot<T>& slt = items[it->idx];
+			if(slt.valid && pred(*(const T*)slt.obj)) {
+				slt.valid = false;
+				((T*)slt.obj)->~T();
+				it->idx = basic_slot_map_invalid;
+				--itemcount;
+				++rtn;
+			}
+		}
+		unlock();
+		return rtn;
+	}
+
 	void clear() noexcept {
 		lock();
 		clear_internal();
@@ -959,7 +1025,7 @@ public:
 				size_t pos = std::distance(items.begin(), it1);
 				for(; it2 != idxs.end(); ++it2) {
 					//can we move this
-					if(it2->count > 0 && it2->idx > pos) {
+					if(it2->count > 0 && it2->idx != basic_slot_map_invalid && it2->idx > pos) {
 						//do the move
 						new (&*it1) slot_internal::basic_slot<T>(std::move(items[it2->idx]));
 
@@ -1058,4 +1124,9 @@ public:
 	}
 };
 
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Pred>
+inline size_t erase_if(basic_slot_map<T, Mut, Alloc, MoonAlloc>& map, Pred pred) {
+	return map.erase_if(pred);
+}
+
 }
@@ -31,6 +31,9 @@ namespace std {
 namespace slot_internal {
 
 void empty_mutex::lock() {}
+bool empty_mutex::try_lock() {
+	return true;
+}
 void empty_mutex::unlock() {}
 
 }
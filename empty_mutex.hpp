@@ -32,6 +32,7 @@ namespace slot_internal {
 //no lock mutex
 struct empty_mutex {
 	void lock();
+	bool try_lock();
 	void unlock();
 };
 
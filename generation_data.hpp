@@ -27,6 +27,7 @@
 
 #include <limits>
 #include <vector>
+#include <string.h>
 
 namespace std {
 
@@ -34,7 +35,6 @@ namespace slot_internal {
 
 template<typename T>
 struct generation_data {
-private:
 	struct counts {
 		T weakcount;
 		T strongcount;
@@ -43,6 +43,7 @@ private:
 			return weakcount == 0 && strongcount == 0;
 		}
 	};
+private:
 	bool isvalid;									//is this current generation valid?
 	bool isvec;										//is gens a generation of vectors?
 	T base;											//the algorithms remove the 0'th element, this is the number removed
@@ -77,12 +78,27 @@ private:
 		} else {
 			//get the top most generation
 			T lgen = 0;
-			char* lst = (char*)gens;
+			const char* lst = (const char*)gens;
 			get_current_gen(lgen, lst);
 			return lgen + base;
 		}
 	}
 public:
+	generation_data() = default;
+	//relocate, a spilled vector now belongs to this (index tables grow by moving these)
+	generation_data(generation_data&& rhs) {
+		memcpy((void*)this, (const void*)&rhs, sizeof(generation_data));
+		rhs.isvec = false;
+	}
+	generation_data& operator=(generation_data&& rhs) {
+		if(this != &rhs) {
+			this->~generation_data();
+			memcpy((void*)this, (const void*)&rhs, sizeof(generation_data));
+			rhs.isvec = false;
+		}
+		return *this;
+	}
+
 	T new_generation() {
 		isvalid = true;
 		//return the new generation, count = 1
@@ -109,7 +125,7 @@ public:
 
 				std::vector<counts>& vec = *((std::vector<counts>*)gens);
 				vec.push_back(counts{0, 1});
-				return vec.size() - 1;
+				return (vec.size() - 1) + base;
 			} else {
 				if(lgen != 0 || !((counts*)gens)[0].is_zero())
 					lgen += 1;
@@ -192,30 +208,40 @@ public:
 				--lst[pgen].strongcount;
 			//de-base this
 			if(pgen == 0 && lst[0].is_zero()) {
-				T lgen = 0;
-				const char* lst = (const char*)gens;
-				get_current_gen(lgen, lst);
+				const size_t cnt = sizeof(std::vector<counts>) / sizeof(counts);
+				size_t z = 0;
+				while(z < cnt && lst[z].is_zero())
+					++z;
 
-				if(lgen == 0)
+				if(z == cnt)
 					//no outstanding handles to this, safe to zero base
 					base = 0;
 				else {
-					base -= lgen;
-
-					//move the data by lgen (pop_front)
-					counts* lst = (counts*)gens;
-					size_t i = 0;
-					size_t k = lgen;
-					//do copy
-					for(; i <= lgen; ++i, ++k)
-						lst[i] = lst[k];
-					//zero the remaining data
-					for(; k * sizeof(counts) < sizeof(std::vector<counts>); ++k)
-						lst[k] = counts{0, 0};
+					base += z;
+
+					//move the data by the unused generations (pop_front)
+					for(size_t i = 0; i < cnt; ++i)
+						lst[i] = i + z < cnt ? lst[i + z] : counts{0, 0};
 				}
 			}
 		}
 	}
+	//the generation a new handle gets, used to save a slot
+	inline T get_current_generation() {
+		return current_generation();
+	}
+	//after a load, gen is the current generation and no handle counts yet
+	void restore_generation(T gen) {
+		if(isvec) {
+			using vctr = std::vector<counts>;
+			vctr& vec = *((vctr*)gens);
+			vec.~vctr();
+			isvec = false;
+		}
+		memset(gens, 0, sizeof(std::vector<counts>));
+		base = gen;
+		isvalid = true;
+	}
 	inline void set_invalid() {
 		isvalid = false;
 	}
@@ -0,0 +1,185 @@
+/*----------------------------------------------------------------------------------*\
+ |																					|
+ | huge_page_allocator.hpp 															|
+ |																					|
+ | Author: (C) Copyright Richard Cookman 2019										|
+ |																					|
+ | Permission is hereby granted, free of charge, to any person obtaining a copy		|
+ | of this software and associated documentation files (the "Software"), to deal	|
+ | in the Software without restriction, including without limitation the rights		|
+ | to use, copy, modify, merge, publish, distribute, sublicense, and/or sell		|
+ | copies of the Software, and to permit persons to whom the Software is			|
+ | furnished to do so, subject to the following conditions:							|
+ |																					|
+ | The above copyright notice and this permission notice shall be included in all	|
+ | copies or substantial portions of the Software.									|
+ |																					|
+ | THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR		|
+ | IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,			|
+ | FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE		|
+ | AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER			|
+ | LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,	|
+ | OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE	|
+ | SOFTWARE.																		|
+ |																					|
+\*----------------------------------------------------------------------------------*/
+#pragma once
+
+#include <limits>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace std {
+
+namespace slot_internal {
+
+//size of a transparent huge page on x86-64/aarch64, smaller allocations are left to the normal heap
+const size_t huge_page_size = 2 * 1024 * 1024;
+
+inline size_t huge_page_round(size_t bytes) {
+	return (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+}
+
+//what a mapping got, a failed madvise/mbind still leaves usable memory so it is only reported
+const unsigned huge_page_advised = 1;					//madvise(MADV_HUGEPAGE) was accepted
+const unsigned huge_page_bound = 2;						//mbind to the requested node was accepted
+
+//bytes is a multiple of huge_page_size, the block starts on a huge page boundary so the kernel can back it with huge pages
+//status gets the huge_page_advised/huge_page_bound bits of the calls that succeeded
+inline void* huge_page_map(size_t bytes, int node, unsigned& status) {
+	status = 0;
+#if defined(__linux__)
+	//mmap only aligns to the base page, map one huge page more and trim the ends
+	size_t total = bytes + huge_page_size;
+	char* raw = (char*)mmap(0, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(raw == (char*)MAP_FAILED)
+		return 0;
+	char* ptr = (char*)(((uintptr_t)raw + huge_page_size - 1) & ~(uintptr_t)(huge_page_size - 1));
+	if(ptr != raw)
+		munmap(raw, ptr - raw);
+	if(raw + total != ptr + bytes)
+		munmap(ptr + bytes, raw + total - (ptr + bytes));
+#if defined(MADV_HUGEPAGE)
+	//ask for transparent huge pages, cuts the TLB misses on random slot lookups
+	if(madvise(ptr, bytes, MADV_HUGEPAGE) == 0)
+		status |= huge_page_advised;
+#endif
+#if defined(SYS_mbind)
+	if(node >= 0 && node < 256) {
+		//MPOL_BIND, pages are only taken from the given node
+		//done before first touch so no page is faulted in on the wrong node
+		const int mpol_bind = 2;
+		unsigned long mask[256 / (sizeof(unsigned long) * 8)] = {};
+		mask[node / (sizeof(unsigned long) * 8)] = 1ul << (node % (sizeof(unsigned long) * 8));
+		if(syscall(SYS_mbind, ptr, bytes, mpol_bind, mask, sizeof(mask) * 8 + 1, 0) == 0)
+			status |= huge_page_bound;
+	}
+#endif
+	return ptr;
+#else
+	(void)node;
+	//no huge page api, still hand out a huge page aligned block, the heap pointer is kept just in front of it
+	char* raw = (char*)::operator new(bytes + huge_page_size, std::nothrow);
+	if(raw == 0)
+		return 0;
+	char* ptr = (char*)(((uintptr_t)raw + sizeof(void*) + huge_page_size - 1) & ~(uintptr_t)(huge_page_size - 1));
+	((void**)ptr)[-1] = raw;
+	return ptr;
+#endif
+}
+
+inline void huge_page_unmap(void* ptr, size_t bytes) {
+#if defined(__linux__)
+	munmap(ptr, bytes);
+#else
+	(void)bytes;
+	::operator delete(((void**)ptr)[-1]);
+#endif
+}
+
+}
+
+//allocator for large item/index arrays, memory is mapped directly and backed by huge pages
+//Node selects the numa node the memory is bound to, -1 leaves placement to the os
+//allocations smaller than one huge page go through the normal heap
+template<typename T, int Node = -1>
+struct huge_page_allocator {
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<typename U>
+	struct rebind {
+		typedef huge_page_allocator<U, Node> other;
+	};
+
+	huge_page_allocator() = default;
+	template<typename U>
+	huge_page_allocator(const huge_page_allocator<U, Node>& rhs)
+		: last_status(rhs.status())
+	{}
+
+	T* allocate(size_t n) {
+		//room for the rounding and the extra huge page used to align the mapping
+		if(n > (std::numeric_limits<size_t>::max() - 2 * slot_internal::huge_page_size) / sizeof(T))
+			throw std::bad_alloc();
+		size_t bytes = n * sizeof(T);
+		if(bytes < slot_internal::huge_page_size)
+			return (T*)::operator new(bytes);
+
+		void* ptr = slot_internal::huge_page_map(slot_internal::huge_page_round(bytes), Node, last_status);
+		if(ptr == 0)
+			throw std::bad_alloc();
+		return (T*)ptr;
+	}
+	void deallocate(T* ptr, size_t n) {
+		if(ptr == 0)
+			return;
+		size_t bytes = n * sizeof(T);
+		if(bytes < slot_internal::huge_page_size)
+			::operator delete(ptr);
+		else
+			slot_internal::huge_page_unmap(ptr, slot_internal::huge_page_round(bytes));
+	}
+
+	inline size_t max_size() const noexcept {
+		return std::numeric_limits<size_t>::max() / sizeof(T);
+	}
+
+	//slot_internal::huge_page_advised/huge_page_bound bits of the last mapping this allocator made, 0 before the first
+	//one and on hosts without transparent huge pages or numa, the memory works either way
+	inline unsigned status() const noexcept {
+		return last_status;
+	}
+	inline bool huge_pages() const noexcept {
+		return (last_status & slot_internal::huge_page_advised) != 0;
+	}
+	inline bool node_bound() const noexcept {
+		return (last_status & slot_internal::huge_page_bound) != 0;
+	}
+
+private:
+	unsigned last_status = 0;
+};
+
+template<typename T, typename U, int Node>
+inline bool operator==(const huge_page_allocator<T, Node>&, const huge_page_allocator<U, Node>&) {
+	return true;
+}
+template<typename T, typename U, int Node>
+inline bool operator!=(const huge_page_allocator<T, Node>&, const huge_page_allocator<U, Node>&) {
+	return false;
+}
+
+}
@@ -24,12 +24,22 @@
  |																					|
 \*----------------------------------------------------------------------------------*/
 
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include "ordered_slot_map.hpp"
 #include "basic_ordered_slot_map.hpp"
 #include "slot_map.hpp"
 #include "basic_slot_map.hpp"
+#include "slot_map_serialize.hpp"
+#include "mapped_slot_map.hpp"
+#include "slot_heap.hpp"
+#include "huge_page_allocator.hpp"
 
 using namespace std;
 
@@ -52,6 +62,61 @@ struct slot_data {
 	}
 };
 
+//orders slot_data by a alone, objects with the same a are equal
+struct slot_data_a_less {
+	bool operator()(const slot_data& lhs, const slot_data& rhs) const {
+		return lhs.a < rhs.a;
+	}
+};
+
+//KeyOf for ordered_slot_map, a comes first in operator< so the key keeps its order
+struct slot_data_key {
+	unsigned operator()(const slot_data& obj) const {
+		return obj.a;
+	}
+};
+
+//orders slot_data by a and compares a against plain keys, a transparent comparison
+struct slot_data_a_key_less {
+	typedef void is_transparent;
+	bool operator()(const slot_data& lhs, const slot_data& rhs) const {
+		return lhs.a < rhs.a;
+	}
+	bool operator()(const slot_data& lhs, unsigned rhs) const {
+		return lhs.a < rhs;
+	}
+	bool operator()(unsigned lhs, const slot_data& rhs) const {
+		return lhs < rhs.a;
+	}
+};
+
+//stateful comparison, orders slot_data by a or b picked at construction
+struct slot_data_field_less {
+	bool byb;
+	slot_data_field_less(bool b = false)
+		: byb(b)
+	{}
+	bool operator()(const slot_data& lhs, const slot_data& rhs) const {
+		return byb ? lhs.b < rhs.b : lhs.a < rhs.a;
+	}
+};
+
+//not trivially copyable, the slot maps copy it with its copy constructor
+struct slot_copy_data {
+	unsigned val;
+
+	slot_copy_data(unsigned v)
+		: val(v)
+	{}
+	slot_copy_data(const slot_copy_data& rhs)
+		: val(rhs.val)
+	{}
+	slot_copy_data& operator=(const slot_copy_data& rhs) = default;
+	bool operator==(const slot_copy_data& rhs) const {
+		return val == rhs.val;
+	}
+};
+
 void slot_map_test() {
 	cout << "--- slot_map_test ---" << endl;
 	//slot_map tests
@@ -216,6 +281,343 @@ void ordered_slot_map_test() {
 	cout << endl;
 }
 
+void ordered_slot_map_defragment_test() {
+	cout << "--- ordered_slot_map_defragment_test ---" << endl;
+	ordered_slot_map<slot_data> map;
+
+	//equal objects are ordered by node address, objects only the map references are moved between nodes
+	//so the kept handles sit between movable equal objects
+	std::vector<ordered_slot_map<slot_data>::handle> hdls;
+	for(unsigned i = 0; i < 8; ++i) {
+		map.insert(slot_data{2, 0}, true);
+		hdls.push_back(map.insert(slot_data{2, 0}));
+		map.insert(slot_data{i % 2, 0}, true);
+	}
+
+	map.defragment();
+
+	//each kept handle's rank is where iteration finds its object
+	size_t found = 0;
+	for(size_t i = 0; i < hdls.size(); ++i) {
+		size_t pos = 0;
+		for(auto it = map.begin(); it != map.end() && &*it != map.get_object(hdls[i]); ++it)
+			++pos;
+		if(map.rank(hdls[i]) == pos)
+			++found;
+	}
+	cout << "ranks found : " << found << " of " << hdls.size() << endl;
+
+	size_t sze = map.size();
+	for(size_t i = 0; i < hdls.size(); ++i)
+		map.erase(hdls[i]);
+	cout << "erased : " << sze - map.size() << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_snapshot_test() {
+	cout << "--- ordered_slot_map_snapshot_test ---" << endl;
+	ordered_slot_map<unsigned> map;
+	for(unsigned i = 1; i <= 5; ++i)
+		map.insert(i * 10, true);
+	auto hdl = map.insert(35u);
+
+	ordered_slot_map<unsigned>::snapshot_type snap = map.snapshot();
+	cout << "snapshots shared : " << (snap == map.snapshot()) << endl;
+
+	//a held snapshot keeps the values it was taken with
+	map.insert(5u, true);
+	map.modify(hdl, [](unsigned& obj) { obj = 100; });
+	map.erase_if([](const unsigned& obj) { return obj == 20; });
+	cout << "held snapshot :";
+	for(auto it = snap->begin(); it != snap->end(); ++it)
+		cout << " " << *it;
+	cout << endl;
+	cout << "new snapshot :";
+	ordered_slot_map<unsigned>::snapshot_type now = map.snapshot();
+	for(auto it = now->begin(); it != now->end(); ++it)
+		cout << " " << *it;
+	cout << endl;
+
+	//a copy of a map whose objects are all owned shares its snapshot
+	for(unsigned i = 0; i < 4; ++i)
+		map.insert(30u, true);
+	map.erase(hdl);
+	now = map.snapshot();
+	ordered_slot_map<unsigned> copy(map);
+	cout << "copy shares snapshot : " << (copy.snapshot() == now) << ", copy size : " << copy.size() << endl;
+	bool same = copy.size() == map.size();
+	for(auto it = map.begin(), cit = copy.begin(); same && it != map.end(); ++it, ++cit)
+		same = *it == *cit;
+	cout << "copy in order : " << same << endl;
+	copy.insert(1u, true);
+	cout << "copy changed, source snapshot size : " << map.snapshot()->size() << ", copy snapshot size : " << copy.snapshot()->size() << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_search_test() {
+	cout << "--- ordered_slot_map_search_test ---" << endl;
+	ordered_slot_map<unsigned> map;
+	for(unsigned i = 0; i < 100; ++i)
+		map.insert(2 * i, true);
+
+	//the eytzinger copy gives the same positions as lower_bound on the map
+	size_t same = 0;
+	for(unsigned v = 0; v <= 200; ++v)
+		if(map.lower_bound_rank(v) == (size_t)std::distance(map.begin(), map.lower_bound(v)))
+			++same;
+	cout << "ranks matching lower_bound : " << same << " of 201" << endl;
+	cout << "lower_bound_rank(51) : " << map.lower_bound_rank(51u) << ", nth : " << *map.nth(map.lower_bound_rank(51u)) << endl;
+
+	//a change drops the copy, the next search rebuilds it
+	auto hdl = map.insert(51u);
+	cout << "after insert, lower_bound_rank(51) : " << map.lower_bound_rank(51u) << ", nth : " << *map.nth(map.lower_bound_rank(51u)) << endl;
+	map.erase(hdl);
+	cout << "after erase, lower_bound_rank(51) : " << map.lower_bound_rank(51u) << endl;
+
+	//the index on its own, runs of equal values and every size up to a few levels
+	size_t checked = 0, wrong = 0;
+	for(unsigned sze = 0; sze < 40; ++sze) {
+		std::vector<unsigned> vals;
+		for(unsigned i = 0; i < sze; ++i)
+			vals.push_back(i / 3);
+		slot_internal::eytzinger_index<unsigned> idx(vals.begin(), vals.end());
+		for(unsigned v = 0; v <= sze / 3 + 1; ++v, ++checked)
+			if(idx.lower_bound(v) != (size_t)(std::lower_bound(vals.begin(), vals.end(), v) - vals.begin()))
+				++wrong;
+	}
+	cout << "eytzinger_index searches : " << checked << ", wrong : " << wrong << endl;
+	cout << endl;
+}
+
+void huge_page_allocator_test() {
+	cout << "--- huge_page_allocator_test ---" << endl;
+	//big enough for the slot array to be mapped directly, smaller arrays go through the heap
+	slot_map<slot_data, slot_internal::empty_mutex, huge_page_allocator<slot_data>> map(200000);
+	slot_map<slot_data, slot_internal::empty_mutex, huge_page_allocator<slot_data>>::handle hdl1 = map.insert(slot_data{50, 85});
+	std::vector<slot_map<slot_data, slot_internal::empty_mutex, huge_page_allocator<slot_data>>::handle> hdls;
+	for(unsigned i = 0; i < 300000; ++i)
+		hdls.push_back(map.insert(slot_data{i, i}));
+	slot_map<slot_data, slot_internal::empty_mutex, huge_page_allocator<slot_data>>::handle hdl2 = map.insert(slot_data{200, 100});
+	cout << "slot_map size : " << map.size() << ", hdl1 : " << hdl1->a << " " << hdl1->b << ", hdl2 : " << hdl2->a << " " << hdl2->b << endl;
+
+	basic_slot_map<slot_data, slot_internal::empty_mutex, huge_page_allocator<slot_data, 0>> bmap;
+	auto bhdl = bmap.insert(slot_data{150, 95});
+	basic_ordered_slot_map<unsigned, slot_internal::empty_mutex, huge_page_allocator<unsigned>> bomap;
+	auto bohdl = bomap.insert(7u);
+	ordered_slot_map<unsigned, slot_internal::empty_mutex, huge_page_allocator<slot_internal::ordered_slot_map_object<unsigned, slot_internal::empty_mutex>*>> omap;
+	auto ohdl = omap.insert(9u);
+	cout << "basic_slot_map : " << bhdl->a << ", basic_ordered_slot_map : " << *bohdl << ", ordered_slot_map : " << *ohdl << endl;
+
+	//the madvise/mbind results are kept on the allocator, either way the memory is usable
+	std::vector<unsigned, huge_page_allocator<unsigned>> vals(1000000, 1);
+	unsigned status = vals.get_allocator().status();
+	size_t sum = 0;
+	for(size_t i = 0; i < vals.size(); ++i)
+		sum += vals[i];
+	cout << "vector sum : " << sum << ", status known : " << ((status & ~(slot_internal::huge_page_advised | slot_internal::huge_page_bound)) == 0) << endl;
+	cout << endl;
+}
+
+void slot_map_serialize_test() {
+	cout << "--- slot_map_serialize_test ---" << endl;
+	slot_map<slot_data> map;
+
+	auto hdl1 = map.insert(slot_data{50, 85});
+	auto hdl2 = map.insert(slot_data{200, 100});
+	auto hdl3 = map.insert(slot_data{150, 95});
+	map.erase(hdl2);
+
+	//trivially copyable objects are written as one block, handles after the map
+	stringstream file;
+	if(save(file, map) && save_handle(file, hdl1) && save_handle(file, hdl2) && save_handle(file, hdl3))
+		cout << "map saved" << endl;
+	string bytes = file.str();
+
+	slot_map<slot_data> loaded;
+	if(load(file, loaded))
+		cout << "map loaded, size : " << loaded.size() << endl;
+
+	slot_map<slot_data>::handle ld1, ld2, ld3;
+	if(load_handle(file, loaded, ld1))
+		cout << "ld1 : " << ld1->a << " " << ld1->b << endl;
+	if(!load_handle(file, loaded, ld2))
+		cout << "ld2 was erased, not loaded" << endl;
+	if(load_handle(file, loaded, ld3))
+		cout << "ld3 : " << ld3->a << " " << ld3->b << endl;
+
+	cout << "--------------------" << endl;
+
+	//bad streams leave the map as it was
+	stringstream cut(bytes.substr(0, bytes.size() / 2));
+	if(!load(cut, loaded))
+		cout << "truncated stream not loaded, size : " << loaded.size() << endl;
+
+	stringstream other(bytes);
+	slot_map<unsigned> wrong;
+	if(!load(other, wrong))
+		cout << "different object size not loaded" << endl;
+
+	cout << "--------------------" << endl;
+
+	//other objects go through a writer and a reader
+	slot_map<vector<unsigned>> vecs;
+	auto vhdl1 = vecs.insert(vector<unsigned>{1, 2, 3});
+	auto vhdl2 = vecs.insert(vector<unsigned>{4});
+	auto wrt = [](ostream& os, const vector<unsigned>& v) {
+		os << v.size();
+		for(size_t i = 0; i < v.size(); ++i)
+			os << ' ' << v[i];
+		os << ' ';
+	};
+	auto rd = [](istream& is) {
+		size_t n = 0;
+		is >> n;
+		vector<unsigned> v(n);
+		for(size_t i = 0; i < n; ++i)
+			is >> v[i];
+		is.get();
+		return v;
+	};
+	stringstream vfile, hfile;
+	if(save(vfile, vecs, wrt) && save_handle(hfile, vhdl1) && save_handle(hfile, vhdl2))
+		cout << "vector map saved" << endl;
+	string vbytes = vfile.str();
+
+	slot_map<vector<unsigned>> vloaded;
+	slot_map<vector<unsigned>>::handle vld1, vld2;
+	if(load(vfile, vloaded, rd) && load_handle(hfile, vloaded, vld1) && load_handle(hfile, vloaded, vld2))
+		cout << "vector map loaded, vld1 size : " << vld1->size() << " vld2[0] : " << (*vld2)[0] << endl;
+
+	stringstream vcut(vbytes.substr(0, vbytes.size() - 4));
+	slot_map<vector<unsigned>> vbad;
+	if(!load(vcut, vbad, rd))
+		cout << "truncated vector map not loaded, size : " << vbad.size() << endl;
+	cout << endl;
+}
+
+void slot_map_delta_test() {
+	cout << "--- slot_map_delta_test ---" << endl;
+	slot_map<slot_data> map;
+	std::vector<slot_map<slot_data>::handle> hdls;
+	for(unsigned i = 0; i < 200; ++i)
+		hdls.push_back(map.insert(slot_data{i, i}));
+
+	stringstream file;
+	save(file, map);
+	size_t full = file.str().size();
+	slot_map<slot_data> replica;
+	load(file, replica);
+
+	//const reads don't change a slot, the delta is only the header
+	unsigned sum = 0;
+	const std::vector<slot_map<slot_data>::handle>& chdls = hdls;
+	for(auto it = chdls.begin(); it != chdls.end(); ++it)
+		sum += (*it)->a + map.get_object(*it)->b;
+	for(auto it = map.cbegin(); it != map.cend(); ++it)
+		sum += it->a;
+	stringstream read_delta;
+	write_delta(read_delta, map);
+	cout << "sum : " << sum << ", delta after reads smaller than save : " << (read_delta.str().size() < full / 10) << endl;
+	apply_delta(read_delta, replica);
+
+	//writes through a handle, get_object, an iterator (every slot it dereferences counts) and modify
+	hdls[10]->a = 1000;
+	map.get_object(hdls[20])->b = 2000;
+	for(auto it = map.begin(); it != map.end(); ++it)
+		if(it->a == 40) {
+			it->a = 3000;
+			break;
+		}
+	map.modify(hdls[50], [](slot_data& obj) { obj.b = 4000; });
+	map.erase(hdls[30]);
+	stringstream small_delta;
+	write_delta(small_delta, map);
+	cout << "small delta smaller than save : " << (small_delta.str().size() < full / 2) << endl;
+	if(apply_delta(small_delta, replica)) {
+		size_t written = 0;
+		for(auto it = replica.cbegin(); it != replica.cend(); ++it)
+			if(it->a == 1000 || it->b == 2000 || it->a == 3000 || it->b == 4000)
+				++written;
+		cout << "replica size : " << replica.size() << ", written objects : " << written << endl;
+	}
+
+	//most slots changed, a full snapshot is cheaper
+	for(unsigned i = 0; i < 150; ++i)
+		map.modify(hdls[i], [](slot_data& obj) { ++obj.b; });
+	stringstream big_delta;
+	write_delta(big_delta, map);
+	cout << "big delta is a snapshot : " << (big_delta.str().compare(0, 4, "SLMP") == 0) << endl;
+	if(apply_delta(big_delta, replica)) {
+		bool same = replica.size() == map.size();
+		for(auto it = map.cbegin(), rit = replica.cbegin(); same && it != map.cend(); ++it, ++rit)
+			same = it->a == rit->a && it->b == rit->b;
+		cout << "replica matches : " << same << endl;
+	}
+	cout << endl;
+}
+
+void mapped_slot_map_test() {
+	cout << "--- mapped_slot_map_test ---" << endl;
+	const char* path = "mapped_slot_map_test.map";
+	std::remove(path);
+
+	mapped_slot_map_handle hdl1, hdl2, hdl3;
+	{
+		//read_write creates the file, objects are written straight into it
+		mapped_slot_map<slot_data> map(path, mapped_read_write);
+		if(!map.is_open()) {
+			cout << "can't map " << path << endl << endl;
+			return;
+		}
+		hdl1 = map.insert(slot_data{50, 85});
+		hdl2 = map.insert(slot_data{200, 100});
+		for(unsigned i = 0; i < 100; ++i)
+			map.insert(slot_data{i, i});
+		hdl3 = map.insert(slot_data{150, 95});
+		map.erase(hdl2);
+		map.get_object(hdl1)->b = 86;
+		if(map.sync())
+			cout << "read_write size : " << map.size() << endl;
+	}
+
+	{
+		mapped_slot_map<slot_data> map(path, mapped_read_only);
+		cout << "read_only size : " << map.size() << endl;
+		const slot_data* itm = map.get_object(hdl1);
+		if(itm)
+			cout << "hdl1 : " << itm->a << " " << itm->b << endl;
+		if(!map.is_valid(hdl2))
+			cout << "hdl2 is invalid" << endl;
+		if(!map.is_valid(map.insert(slot_data{1, 1})))
+			cout << "read_only insert refused" << endl;
+	}
+
+	{
+		//copy_on_write changes stay in this process, growing moves the map out of the file
+		mapped_slot_map<slot_data> map(path, mapped_copy_on_write);
+		map.get_object(hdl3)->a = 0;
+		for(unsigned i = 0; i < 1000; ++i)
+			map.insert(slot_data{i, i});
+		cout << "copy_on_write size : " << map.size() << " hdl3.a : " << map.get_object(hdl3)->a << endl;
+	}
+
+	{
+		mapped_slot_map<slot_data> map(path, mapped_read_only);
+		cout << "file unchanged, size : " << map.size() << " hdl3.a : " << map.get_object(hdl3)->a << endl;
+
+		size_t n = 0;
+		for(auto it = map.begin(); it != map.end(); ++it)
+			++n;
+		cout << "iterated : " << n << endl;
+
+		mapped_slot_map<unsigned> wrong;
+		if(!wrong.open(path, mapped_read_only))
+			cout << "different object size not mapped" << endl;
+	}
+	std::remove(path);
+	cout << endl;
+}
+
 void basic_slot_map_test() {
 	cout << "--- basic_slot_map_test ---" << endl;
 	//slot_map tests
@@ -342,11 +744,552 @@ void basic_ordered_slot_map_test() {
 	cout << endl;
 }
 
+void slot_heap_test() {
+	cout << "--- slot_heap_test ---" << endl;
+	slot_heap<unsigned> q;
+
+	slot_heap<unsigned>::handle hdl10 = q.push(10u);
+	slot_heap<unsigned>::handle hdl5 = q.push(5u);
+	slot_heap<unsigned>::handle hdl20 = q.push(20u);
+	{
+		//a dropped strong handle erases its object
+		slot_heap<unsigned>::handle tmp = q.push(1u);
+	}
+	cout << "size : " << q.size() << " top : " << q.top() << endl;
+
+	//smallest first, the opposite of std::priority_queue with the same Compare
+	q.update(hdl10, 1u);
+	cout << "decreased 10 to 1, top : " << q.top() << endl;
+	q.modify(hdl10, [](unsigned& obj) { obj = 30; });
+	cout << "increased 1 to 30, top : " << q.top() << endl;
+
+	slot_heap<unsigned>::weak_handle wkhdl = hdl20;
+	q.erase(hdl5);
+	if(!q.is_valid(hdl5))
+		cout << "hdl5 is invalid" << endl;
+	cout << "top : " << q.top() << " wkhdl : " << *wkhdl << endl;
+
+	std::vector<slot_heap<unsigned>::handle> hdls;
+	for(unsigned i = 0; i < 100; ++i)
+		hdls.push_back(q.push((i * 37) % 100));
+	for(unsigned i = 0; i < 100; i += 2)
+		q.modify(hdls[i], [](unsigned& obj) { obj += 100; });
+
+	unsigned last = 0;
+	size_t n = 0;
+	bool sorted = true;
+	while(!q.empty()) {
+		if(q.top() < last)
+			sorted = false;
+		last = q.top();
+		q.pop();
+		++n;
+	}
+	cout << "popped : " << n << (sorted ? " in order" : " out of order") << endl;
+	if(!q.is_valid(wkhdl))
+		cout << "wkhdl is invalid" << endl;
+	cout << endl;
+}
+
+void basic_ordered_slot_map_batch_test() {
+	cout << "--- basic_ordered_slot_map_batch_test ---" << endl;
+	typedef basic_ordered_slot_map<slot_data, slot_internal::empty_mutex, std::allocator<slot_data>,
+								   std::allocator<slot_internal::slot_map_moon<slot_internal::empty_mutex>>, slot_data_a_less> map_type;
+
+	//a batch that is big next to the map is merged in one pass, a small one is inserted one by one
+	size_t sizes[2] = {3, 200};
+	for(size_t k = 0; k < 2; ++k) {
+		map_type one, batch;
+		std::vector<map_type::handle> hdls;
+		for(unsigned i = 0; i < sizes[k]; ++i) {
+			hdls.push_back(one.insert(slot_data{i % 5, i}));
+			hdls.push_back(batch.insert(slot_data{i % 5, i}));
+		}
+
+		std::vector<slot_data> vals;
+		for(unsigned i = 0; i < 6; ++i)
+			vals.push_back(slot_data{(i * 3) % 4, 1000 + i});
+		for(auto it = vals.begin(); it != vals.end(); ++it)
+			hdls.push_back(one.insert(*it));
+		std::vector<map_type::handle> bhdls = batch.insert(vals.begin(), vals.end());
+
+		//equal objects sit in the same order whichever way they went in
+		bool same = one.size() == batch.size();
+		for(auto it = one.begin(), bit = batch.begin(); same && it != one.end(); ++it, ++bit)
+			same = it->a == bit->a && it->b == bit->b;
+		cout << "map of " << sizes[k] << " plus batch of " << vals.size() << ", same order as one by one : " << same << endl;
+		cout << "batch handles valid : " << (batch.is_valid(bhdls.front()) && batch.is_valid(bhdls.back())) << ", first : " << bhdls.front()->b << endl;
+	}
+	cout << endl;
+}
+
+void erase_if_test() {
+	cout << "--- erase_if_test ---" << endl;
+	//each map erases the odd objects in one sweep, handles to them go invalid and the rest stay valid
+	slot_map<unsigned> smap;
+	basic_slot_map<unsigned> bmap;
+	ordered_slot_map<unsigned> omap;
+	basic_ordered_slot_map<unsigned> bomap;
+	std::vector<slot_map<unsigned>::handle> shdls;
+	std::vector<basic_slot_map<unsigned>::handle> bhdls;
+	std::vector<ordered_slot_map<unsigned>::handle> ohdls;
+	std::vector<basic_ordered_slot_map<unsigned>::handle> bohdls;
+	for(unsigned i = 0; i < 20; ++i) {
+		shdls.push_back(smap.insert(i));
+		bhdls.push_back(bmap.insert(i));
+		ohdls.push_back(omap.insert(i));
+		bohdls.push_back(bomap.insert(i));
+	}
+
+	auto odd = [](const unsigned& obj) { return obj % 2 == 1; };
+	cout << "erased slot_map : " << erase_if(smap, odd) << ", basic_slot_map : " << erase_if(bmap, odd)
+		 << ", ordered_slot_map : " << erase_if(omap, odd) << ", basic_ordered_slot_map : " << erase_if(bomap, odd) << endl;
+
+	size_t right = 0;
+	for(unsigned i = 0; i < 20; ++i) {
+		bool keep = i % 2 == 0;
+		right += smap.is_valid(shdls[i]) == keep;
+		right += bmap.is_valid(bhdls[i]) == keep;
+		right += omap.is_valid(ohdls[i]) == keep;
+		right += bomap.is_valid(bohdls[i]) == keep;
+	}
+	cout << "handles right : " << right << " of 80" << endl;
+	cout << "ordered_slot_map first : " << *omap.begin() << ", basic_ordered_slot_map last : " << *(--bomap.end()) << endl;
+
+	//erase leaves no index pointing at the slot, so once the slot is reused the erase_if sweep and the erased handles don't reach it
+	basic_slot_map<unsigned> map;
+	std::vector<basic_slot_map<unsigned>::handle> hdls;
+	for(unsigned i = 0; i < 3; ++i)
+		hdls.push_back(map.insert(i));
+	basic_slot_map<unsigned>::handle copy = hdls[0];
+	map.erase(hdls[0]);
+	map.erase(hdls[1]);
+	for(unsigned i = 0; i < 48; ++i)
+		hdls.push_back(map.insert(100 + i));
+	size_t called = 0;
+	map.erase_if([&called](const unsigned&) { ++called; return false; });
+	cout << "objects : " << map.size() << ", predicate calls : " << called << ", erased copy valid : " << map.is_valid(copy) << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_key_test() {
+	cout << "--- ordered_slot_map_key_test ---" << endl;
+	typedef ordered_slot_map<slot_data, slot_internal::empty_mutex, std::vector<slot_internal::ordered_slot_map_object<slot_data>*>::allocator_type,
+							 std::allocator<slot_internal::ordered_slot_map_object<slot_data>>,
+							 std::allocator<slot_internal::ordered_slot_map_moon<slot_internal::empty_mutex>>, slot_data_key> map_type;
+	map_type map;
+
+	//searches compare the a kept next to each pointer, objects with the same a are compared in full
+	std::vector<map_type::handle> hdls;
+	for(unsigned i = 0; i < 20; ++i)
+		hdls.push_back(map.insert(slot_data{(i * 7) % 5, i}));
+	bool sorted = true;
+	const slot_data* prev = 0;
+	for(auto it = map.begin(); it != map.end(); ++it) {
+		if(prev && *it < *prev)
+			sorted = false;
+		prev = &*it;
+	}
+	cout << "sorted : " << sorted << endl;
+	auto it = map.lower_bound(slot_data{3, 10});
+	cout << "lower_bound {3, 10} : " << it->a << ", " << it->b << endl;
+	cout << "find {2, 11} : " << (map.find(slot_data{2, 11}) != map.end()) << ", find {2, 12} : " << (map.find(slot_data{2, 12}) != map.end()) << endl;
+
+	for(size_t i = 0; i < hdls.size(); i += 2)
+		map.erase(hdls[i]);
+	size_t valid = 0;
+	for(size_t i = 0; i < hdls.size(); ++i)
+		valid += map.is_valid(hdls[i]);
+	cout << "after erase size : " << map.size() << ", valid handles : " << valid << ", first : " << map.begin()->a << ", " << map.begin()->b << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_pool_test() {
+	cout << "--- ordered_slot_map_pool_test ---" << endl;
+	typedef ordered_slot_map<slot_data, slot_internal::empty_mutex, std::vector<slot_internal::ordered_slot_map_object<slot_data>*>::allocator_type,
+							 pool_allocator<slot_internal::ordered_slot_map_object<slot_data>>> map_type;
+	map_type map;
+
+	//objects come from the pool slabs, erased objects give their blocks back for the next inserts
+	std::vector<map_type::handle> hdls;
+	for(unsigned i = 0; i < 600; ++i)
+		hdls.push_back(map.insert(slot_data{(i * 37) % 600, i}));
+	std::vector<const slot_data*> freed;
+	for(size_t i = 0; i < hdls.size(); i += 2) {
+		freed.push_back(map.get_object(hdls[i]));
+		map.erase(hdls[i]);
+	}
+	size_t reused = 0;
+	for(unsigned i = 0; i < 300; ++i) {
+		map_type::handle hdl = map.insert(slot_data{i, 1000 + i}, true);
+		reused += std::find(freed.begin(), freed.end(), map.get_object(hdl)) != freed.end();
+	}
+	cout << "size : " << map.size() << ", blocks reused : " << reused << " of 300" << endl;
+
+	bool sorted = true;
+	const slot_data* prev = 0;
+	for(auto it = map.begin(); it != map.end(); ++it) {
+		if(prev && *it < *prev)
+			sorted = false;
+		prev = &*it;
+	}
+	size_t valid = 0;
+	for(size_t i = 1; i < hdls.size(); i += 2)
+		valid += map.is_valid(hdls[i]) && map.get_object(hdls[i])->b == i;
+	cout << "sorted : " << sorted << ", kept handles valid : " << valid << " of 300" << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_btree_test() {
+	cout << "--- ordered_slot_map_btree_test ---" << endl;
+	typedef ordered_slot_map<unsigned, slot_internal::empty_mutex, std::vector<slot_internal::ordered_slot_map_object<unsigned>*>::allocator_type,
+							 std::allocator<slot_internal::ordered_slot_map_object<unsigned>>,
+							 std::allocator<slot_internal::ordered_slot_map_moon<slot_internal::empty_mutex>>,
+							 slot_internal::ordered_slot_map_no_key, slot_map_btree_index<128>> map_type;
+	map_type map;
+	ordered_slot_map<unsigned> vmap;
+
+	//the b+tree index gives the same order and searches as the vector index, small nodes give a few levels
+	std::vector<map_type::handle> hdls;
+	std::vector<ordered_slot_map<unsigned>::handle> vhdls;
+	for(unsigned i = 0; i < 2000; ++i) {
+		hdls.push_back(map.insert((i * 7919) % 1000));
+		vhdls.push_back(vmap.insert((i * 7919) % 1000));
+	}
+	for(size_t i = 0; i < hdls.size(); i += 3) {
+		map.erase(hdls[i]);
+		vmap.erase(vhdls[i]);
+	}
+	cout << "size : " << map.size() << ", same order : " << std::equal(map.begin(), map.end(), vmap.begin()) << endl;
+
+	size_t same = 0;
+	for(unsigned v = 0; v <= 1000; ++v)
+		same += map.lower_bound_rank(v) == vmap.lower_bound_rank(v) && (size_t)std::distance(map.begin(), map.lower_bound(v)) == vmap.lower_bound_rank(v);
+	cout << "lower_bound matching : " << same << " of 1001" << endl;
+
+	size_t ranked = 0, checked = 0;
+	for(size_t i = 1; i < hdls.size(); i += 3, ++checked)
+		ranked += &*map.nth(map.rank(hdls[i])) == map.get_object(hdls[i]);
+	cout << "nth(rank(handle)) finds the object : " << ranked << " of " << checked << endl;
+	cout << endl;
+}
+
+void basic_ordered_slot_map_churn_test() {
+	cout << "--- basic_ordered_slot_map_churn_test ---" << endl;
+	basic_ordered_slot_map<slot_data> map;
+
+	//rounds of inserts and erases split, merge and rebalance the b+tree leaves, every handle must still find its object
+	std::vector<basic_ordered_slot_map<slot_data>::handle> hdls;
+	unsigned next = 0;
+	for(unsigned round = 0; round < 6; ++round) {
+		for(unsigned i = 0; i < 500; ++i, ++next)
+			hdls.push_back(map.insert(slot_data{(next * 7919) % 1000, next}));
+		for(size_t i = round % 3; i < hdls.size(); i += 3)
+			map.erase(hdls[i]);
+		hdls.erase(std::remove_if(hdls.begin(), hdls.end(), [&map](const basic_ordered_slot_map<slot_data>::handle& hdl) {
+			return !map.is_valid(hdl);
+		}), hdls.end());
+	}
+
+	size_t found = 0;
+	for(size_t i = 0; i < hdls.size(); ++i) {
+		const slot_data* obj = map.get_object(hdls[i]);
+		found += obj && obj->a == (obj->b * 7919) % 1000 && &*map.nth(map.rank(hdls[i])) == obj;
+	}
+	bool sorted = true;
+	const slot_data* prev = 0;
+	for(auto it = map.begin(); it != map.end(); ++it) {
+		if(prev && *it < *prev)
+			sorted = false;
+		prev = &*it;
+	}
+	cout << "size : " << map.size() << ", handles finding their object : " << found << " of " << hdls.size() << ", sorted : " << sorted << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_transparent_test() {
+	cout << "--- ordered_slot_map_transparent_test ---" << endl;
+	typedef ordered_slot_map<slot_data, slot_internal::empty_mutex, std::vector<slot_internal::ordered_slot_map_object<slot_data>*>::allocator_type,
+							 std::allocator<slot_internal::ordered_slot_map_object<slot_data>>,
+							 std::allocator<slot_internal::ordered_slot_map_moon<slot_internal::empty_mutex>>,
+							 slot_internal::ordered_slot_map_no_key, slot_map_vector_index, slot_data_a_key_less> map_type;
+	typedef basic_ordered_slot_map<slot_data, slot_internal::empty_mutex, std::allocator<slot_data>,
+								   std::allocator<slot_internal::slot_map_moon<slot_internal::empty_mutex>>, slot_data_a_key_less> basic_map_type;
+	map_type map;
+	basic_map_type bmap;
+	ordered_slot_map<slot_data> dmap;
+	std::vector<basic_map_type::handle> hdls;
+	for(unsigned i = 0; i < 10; ++i) {
+		map.insert(slot_data{i * 10, i}, true);
+		hdls.push_back(bmap.insert(slot_data{i * 10, i}));
+		dmap.insert(slot_data{i * 10, i}, true);
+	}
+
+	//the keys are unsigned, no slot_data is built for the searches
+	cout << "ordered_slot_map find(40) : " << map.find(40u)->b << ", lower_bound(41) : " << map.lower_bound(41u)->a
+		 << ", equal_range(50) : " << std::distance(map.equal_range(50u).first, map.equal_range(50u).second)
+		 << ", find(45) found : " << (map.find(45u) != map.end()) << endl;
+	cout << "basic_ordered_slot_map find(70) : " << bmap.find(70u)->b << ", upper_bound(70) : " << bmap.upper_bound(70u)->a
+		 << ", find(75) found : " << (bmap.find(75u) != bmap.end()) << endl;
+
+	//a map ordered by operator< takes a transparent comparison with the key
+	cout << "default compare, find(20, less) : " << dmap.find(20u, slot_data_a_key_less())->b
+		 << ", lower_bound(95, less) is end : " << (dmap.lower_bound(95u, slot_data_a_key_less()) == dmap.end()) << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_compare_test() {
+	cout << "--- ordered_slot_map_compare_test ---" << endl;
+	typedef ordered_slot_map<slot_data, slot_internal::empty_mutex, std::vector<slot_internal::ordered_slot_map_object<slot_data>*>::allocator_type,
+							 std::allocator<slot_internal::ordered_slot_map_object<slot_data>>,
+							 std::allocator<slot_internal::ordered_slot_map_moon<slot_internal::empty_mutex>>,
+							 slot_internal::ordered_slot_map_no_key, slot_map_vector_index, slot_data_field_less> map_type;
+	typedef basic_ordered_slot_map<slot_data, slot_internal::empty_mutex, std::allocator<slot_data>,
+								   std::allocator<slot_internal::slot_map_moon<slot_internal::empty_mutex>>, slot_data_field_less> basic_map_type;
+
+	//the comparison given to the constructor is kept and used for every insert and search
+	map_type map(slot_data_field_less(true));
+	basic_map_type bmap(slot_data_field_less(true));
+	std::vector<map_type::handle> hdls;
+	std::vector<basic_map_type::handle> bhdls;
+	for(unsigned i = 0; i < 5; ++i) {
+		hdls.push_back(map.insert(slot_data{i, 4 - i}));
+		bhdls.push_back(bmap.insert(slot_data{i, 4 - i}));
+	}
+	cout << "by b, key_comp().byb : " << map.key_comp().byb << ", ordered_slot_map :";
+	for(auto it = map.begin(); it != map.end(); ++it)
+		cout << " " << it->a;
+	cout << ", basic_ordered_slot_map :";
+	for(auto it = bmap.begin(); it != bmap.end(); ++it)
+		cout << " " << it->a;
+	cout << endl;
+	cout << "find {9, 1} by b : " << map.find(slot_data{9, 1})->a << ", " << bmap.find(slot_data{9, 1})->a << endl;
+
+	//resort swaps in a new comparison, handles keep their objects
+	map.resort(slot_data_field_less(false));
+	bmap.resort(slot_data_field_less(false));
+	cout << "by a, key_comp().byb : " << map.key_comp().byb << ", ordered_slot_map :";
+	for(auto it = map.begin(); it != map.end(); ++it)
+		cout << " " << it->a;
+	cout << ", basic_ordered_slot_map :";
+	for(auto it = bmap.begin(); it != bmap.end(); ++it)
+		cout << " " << it->a;
+	cout << endl;
+	size_t valid = 0;
+	for(unsigned i = 0; i < 5; ++i)
+		valid += map.get_object(hdls[i])->a == i && bmap.get_object(bhdls[i])->a == i;
+	bhdls.push_back(bmap.insert(slot_data{2, 100}));
+	cout << "handles valid : " << valid << " of 5, inserted after resort at rank : " << bmap.rank(bhdls.back()) << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_modify_test() {
+	cout << "--- ordered_slot_map_modify_test ---" << endl;
+	ordered_slot_map<unsigned> map;
+	basic_ordered_slot_map<unsigned> bmap;
+	std::vector<ordered_slot_map<unsigned>::handle> hdls;
+	std::vector<basic_ordered_slot_map<unsigned>::handle> bhdls;
+	for(unsigned i = 0; i < 100; ++i) {
+		hdls.push_back(map.insert(i * 10));
+		bhdls.push_back(bmap.insert(i * 10));
+	}
+
+	//a near move stays inside one b+tree leaf, a far one crosses leaves, both forwards and backwards
+	unsigned moves[4][2] = {{50, 535}, {60, 575}, {3, 905}, {97, 5}};
+	for(size_t k = 0; k < 4; ++k) {
+		unsigned idx = moves[k][0];
+		unsigned val = moves[k][1];
+		map.modify(hdls[idx], [val](unsigned& obj) { obj = val; });
+		bmap.modify(bhdls[idx], [val](unsigned& obj) { obj = val; });
+		cout << "item " << idx << " set to " << val << ", rank : " << map.rank(hdls[idx]) << ", " << bmap.rank(bhdls[idx]) << endl;
+	}
+
+	bool sorted = std::is_sorted(map.begin(), map.end()) && std::is_sorted(bmap.begin(), bmap.end());
+	size_t valid = 0;
+	for(unsigned i = 0; i < 100; ++i) {
+		unsigned val = i * 10;
+		for(size_t k = 0; k < 4; ++k)
+			if(moves[k][0] == i)
+				val = moves[k][1];
+		valid += *map.get_object(hdls[i]) == val && *bmap.get_object(bhdls[i]) == val;
+	}
+	cout << "sorted : " << sorted << ", handles valid : " << valid << " of 100" << endl;
+	cout << endl;
+}
+
+void basic_ordered_slot_map_front_test() {
+	cout << "--- basic_ordered_slot_map_front_test ---" << endl;
+	basic_ordered_slot_map<unsigned> map;
+
+	//used as a time ordered queue, the newest go on the back and the oldest come off the front
+	std::vector<basic_ordered_slot_map<unsigned>::handle> hdls;
+	for(unsigned i = 0; i < 200; ++i)
+		hdls.push_back(map.insert(1000 + i));
+	size_t oldest = 0;
+	for(unsigned i = 200; i < 1000; ++i) {
+		hdls.push_back(map.insert(1000 + i));
+		map.erase(hdls[oldest++]);
+	}
+	cout << "queue size : " << map.size() << ", front : " << *map.begin() << ", back : " << *(--map.end()) << endl;
+
+	//inserts in front of everything fill the free space at the start of the first leaf
+	for(unsigned i = 0; i < 50; ++i)
+		hdls.push_back(map.insert(999 - i));
+	size_t valid = 0;
+	for(size_t i = oldest; i < hdls.size(); ++i)
+		valid += map.is_valid(hdls[i]) && map.rank(hdls[i]) == (size_t)std::distance(map.begin(), map.find(*map.get_object(hdls[i])));
+	cout << "after front inserts size : " << map.size() << ", front : " << *map.begin() << ", sorted : " << std::is_sorted(map.begin(), map.end())
+		 << ", handles valid : " << valid << " of " << hdls.size() - oldest << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_ownership_test() {
+	cout << "--- ordered_slot_map_ownership_test ---" << endl;
+	ordered_slot_map<unsigned> map;
+	ordered_slot_map<unsigned> other;
+
+	//owned objects outlive their handles
+	for(unsigned i = 0; i < 10; ++i)
+		map.insert(i, true);
+	cout << "owned objects without handles, size : " << map.size() << endl;
+
+	ordered_slot_map<unsigned>::handle hdl = map.insert(20u, true);
+	ordered_slot_map<unsigned>::weak_handle wkhdl = hdl;
+	cout << "owns : " << map.owns(hdl) << ", release : " << map.release(hdl) << ", release again : " << map.release(hdl)
+		 << ", owns : " << map.owns(hdl) << endl;
+	cout << "own : " << map.own(hdl) << ", own again : " << map.own(hdl) << ", owns : " << map.owns(hdl) << endl;
+
+	//once released the last handle takes the object with it
+	map.release(hdl);
+	hdl = ordered_slot_map<unsigned>::handle();
+	cout << "released and handle dropped, weak handle valid : " << map.is_valid(wkhdl) << ", size : " << map.size() << endl;
+
+	//ownership can be taken through a weak handle, not for objects of another map
+	ordered_slot_map<unsigned>::handle ohdl = other.insert(5u);
+	hdl = map.insert(30u);
+	wkhdl = hdl;
+	bool owned = map.own(wkhdl);
+	hdl = ordered_slot_map<unsigned>::handle();
+	cout << "own weak : " << owned << ", valid after handle dropped : " << map.is_valid(wkhdl)
+		 << ", own other map's object : " << map.own(ohdl) << ", other owns : " << other.owns(ohdl) << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_deref_test() {
+	cout << "--- ordered_slot_map_deref_test ---" << endl;
+	ordered_slot_map<slot_data, std::recursive_mutex> map;
+
+	//handles dereference without a lock while the object is alive
+	ordered_slot_map<slot_data, std::recursive_mutex>::handle hdl1 = map.insert(slot_data{1, 2});
+	ordered_slot_map<slot_data, std::recursive_mutex>::handle hdl2 = hdl1;
+	ordered_slot_map<slot_data, std::recursive_mutex>::weak_handle wkhdl = hdl1;
+	hdl1->b = 3;
+	cout << "hdl2->b : " << hdl2->b << ", (*wkhdl).b : " << (*wkhdl).b << endl;
+
+	//after an erase every copy sees the object is gone, the nodes stay allocated until the last handle lets go
+	map.erase(hdl1);
+	cout << "after erase, hdl2 valid : " << map.is_valid(hdl2) << ", get_object(hdl2) : " << (map.get_object(hdl2) != 0)
+		 << ", wkhdl valid : " << map.is_valid(wkhdl) << ", size : " << map.size() << endl;
+	hdl2 = ordered_slot_map<slot_data, std::recursive_mutex>::handle();
+	wkhdl = ordered_slot_map<slot_data, std::recursive_mutex>::weak_handle();
+
+	//handles can outlive their map
+	ordered_slot_map<slot_data, std::recursive_mutex>::handle kept;
+	{
+		ordered_slot_map<slot_data, std::recursive_mutex> tmp;
+		kept = tmp.insert(slot_data{5, 6}, true);
+		cout << "kept->a : " << kept->a << endl;
+	}
+	kept = ordered_slot_map<slot_data, std::recursive_mutex>::handle();
+	cout << "handle let go after its map" << endl;
+	cout << endl;
+}
+
+void ordered_slot_map_build_test() {
+	cout << "--- ordered_slot_map_build_test ---" << endl;
+	std::vector<slot_data> vals;
+	for(unsigned i = 0; i < 1000; ++i)
+		vals.push_back(slot_data{(i * 7919) % 100, i % 3});
+
+	//the map owns every object it was built from, they stay without any handles
+	ordered_slot_map<slot_data> map(vals.begin(), vals.end());
+	cout << "built size : " << map.size() << ", sorted : " << std::is_sorted(map.begin(), map.end()) << ", front : " << map.begin()->a << ", " << map.begin()->b << endl;
+	ordered_slot_map<slot_data>::handle hdl = map.insert(slot_data{42, 5});
+	cout << "find {42, 1} : " << (map.find(slot_data{42, 1}) != map.end()) << ", rank of inserted {42, 5} : " << map.rank(hdl) << endl;
+
+	//assign drops the old objects and builds again, copies build the same way
+	std::vector<slot_data> fewer(vals.begin(), vals.begin() + 10);
+	map.assign(fewer.begin(), fewer.end());
+	cout << "assigned size : " << map.size() << ", sorted : " << std::is_sorted(map.begin(), map.end()) << ", old handle valid : " << map.is_valid(hdl) << endl;
+	ordered_slot_map<slot_data> copy;
+	copy = map;
+	cout << "copy size : " << copy.size() << ", same : " << std::equal(map.begin(), map.end(), copy.begin(), [](const slot_data& lhs, const slot_data& rhs) {
+		return lhs.a == rhs.a && lhs.b == rhs.b;
+	}) << endl;
+	cout << endl;
+}
+
+template<typename Map, typename Make>
+void clone_check(const char* name, Make make) {
+	Map map;
+	std::vector<typename Map::handle> hdls;
+	for(unsigned i = 0; i < 100; ++i)
+		hdls.push_back(map.insert(make(i)));
+	for(size_t i = 0; i < hdls.size(); i += 4)
+		map.erase(hdls[i]);
+
+	//the clone's handles come back in iteration order and reach copies of the same objects
+	std::vector<typename Map::handle> out;
+	Map copy = map.clone(out);
+	size_t same = 0;
+	auto it = map.begin();
+	for(size_t i = 0; i < out.size() && it != map.end(); ++i, ++it)
+		same += copy.is_valid(out[i]) && *copy.get_object(out[i]) == *it && copy.get_object(out[i]) != &*it;
+
+	//the clone is separate from its source and takes new objects
+	*copy.get_object(out[0]) = make(1000);
+	typename Map::handle hdl = copy.insert(make(2000));
+	cout << name << " clone size : " << copy.size() << ", handles matching : " << same << " of " << map.size()
+		 << ", source unchanged : " << (*map.begin() == make(1)) << ", insert after clone : " << (*copy.get_object(hdl) == make(2000)) << endl;
+}
+
+void slot_map_clone_test() {
+	cout << "--- slot_map_clone_test ---" << endl;
+	//trivially copyable objects are copied with memcpy, others with their copy constructor
+	clone_check<slot_map<unsigned>>("slot_map<unsigned>", [](unsigned i) { return i; });
+	clone_check<basic_slot_map<unsigned>>("basic_slot_map<unsigned>", [](unsigned i) { return i; });
+	clone_check<slot_map<slot_copy_data>>("slot_map<slot_copy_data>", [](unsigned i) { return slot_copy_data(i); });
+	clone_check<basic_slot_map<slot_copy_data>>("basic_slot_map<slot_copy_data>", [](unsigned i) { return slot_copy_data(i); });
+	cout << endl;
+}
+
 int main() {
 	//test each of the slot maps!!!
 	slot_map_test();
+	huge_page_allocator_test();
+	slot_map_serialize_test();
+	slot_map_delta_test();
+	slot_map_clone_test();
+	mapped_slot_map_test();
 	ordered_slot_map_test();
+	ordered_slot_map_ownership_test();
+	ordered_slot_map_deref_test();
+	ordered_slot_map_build_test();
+	ordered_slot_map_key_test();
+	ordered_slot_map_pool_test();
+	ordered_slot_map_btree_test();
+	ordered_slot_map_defragment_test();
+	ordered_slot_map_search_test();
+	ordered_slot_map_transparent_test();
+	ordered_slot_map_compare_test();
+	ordered_slot_map_modify_test();
+	ordered_slot_map_snapshot_test();
 	basic_slot_map_test();
 	basic_ordered_slot_map_test();
+	basic_ordered_slot_map_batch_test();
+	basic_ordered_slot_map_churn_test();
+	basic_ordered_slot_map_front_test();
+	erase_if_test();
+	slot_heap_test();
 	return 0;
 }
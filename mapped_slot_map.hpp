@@ -0,0 +1,485 @@
+/*----------------------------------------------------------------------------------*\
+ |																					|
+ | mapped_slot_map.hpp 																|
+ |																					|
+ | Author: (C) Copyright Richard Cookman 2019										|
+ |																					|
+ | Permission is hereby granted, free of charge, to any person obtaining a copy		|
+ | of this software and associated documentation files (the "Software"), to deal	|
+ | in the Software without restriction, including without limitation the rights		|
+ | to use, copy, modify, merge, publish, distribute, sublicense, and/or sell		|
+ | copies of the Software, and to permit persons to whom the Software is			|
+ | furnished to do so, subject to the following conditions:							|
+ |																					|
+ | The above copyright notice and this permission notice shall be included in all	|
+ | copies or substantial portions of the Software.									|
+ |																					|
+ | THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR		|
+ | IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,			|
+ | FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE		|
+ | AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER			|
+ | LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,	|
+ | OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE	|
+ | SOFTWARE.																		|
+ |																					|
+\*----------------------------------------------------------------------------------*/
+#pragma once
+
+#include <iterator>
+#include <type_traits>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "empty_mutex.hpp"
+
+namespace std {
+
+namespace slot_internal {
+
+const uint32_t mapped_slot_map_version = 1;
+const uint64_t mapped_slot_map_npos = (uint64_t)-1;
+
+//start of the file, the slot array follows it, everything is native byte order and sizes
+struct mapped_slot_map_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t tsize;									//sizeof(T), opening with a different T fails
+	uint64_t slots;
+	uint64_t count;
+	uint64_t firstslot;								//top of the free list, npos when empty
+	char pad[24];									//one cache line
+};
+
+template<typename T>
+struct mapped_slot {
+	uint32_t gen;									//bumped on erase, handles to the old object no longer match
+	uint32_t valid;
+	union slot_data {
+		uint64_t next;								//free slot, the next free slot
+		alignas(alignof(T)) char obj[sizeof(T)];
+	} unn;
+};
+
+}
+
+enum mapped_slot_map_mode {
+	mapped_read_only,								//PROT_READ shared mapping, nothing may be changed
+	mapped_copy_on_write,							//private mapping, changes stay in this process and the file is untouched
+	mapped_read_write								//shared mapping, changes go to the file, a missing file is created
+};
+
+//a handle is plain data (slot and generation), it can be stored in the file of another map and used after a reopen
+//there is no reference counting, objects live until erased
+struct mapped_slot_map_handle {
+	uint64_t idx = slot_internal::mapped_slot_map_npos;
+	uint32_t gen = 0;
+};
+
+template<typename T, typename V>
+struct mapped_slot_map_iterator {
+	typedef std::forward_iterator_tag iterator_category;
+	typedef V value_type;
+	typedef ptrdiff_t difference_type;
+	typedef V& reference;
+	typedef V* pointer;
+
+	slot_internal::mapped_slot<T>* itr = 0;
+	slot_internal::mapped_slot<T>* end = 0;
+
+	mapped_slot_map_iterator() = default;
+	mapped_slot_map_iterator(slot_internal::mapped_slot<T>* it, slot_internal::mapped_slot<T>* e)
+		: itr(it), end(e) {
+		for(; itr != end && !itr->valid; ++itr);
+	}
+
+	inline V& operator*() const {
+		return *(V*)itr->unn.obj;
+	}
+	inline V* operator->() const {
+		return (V*)itr->unn.obj;
+	}
+	inline mapped_slot_map_iterator& operator++() {
+		for(++itr; itr != end && !itr->valid; ++itr);
+		return *this;
+	}
+	inline mapped_slot_map_iterator operator++(int) {
+		mapped_slot_map_iterator rtn = *this;
+		++*this;
+		return rtn;
+	}
+	inline bool operator==(const mapped_slot_map_iterator& rhs) const {
+		return itr == rhs.itr;
+	}
+	inline bool operator!=(const mapped_slot_map_iterator& rhs) const {
+		return itr != rhs.itr;
+	}
+};
+
+//slot map whose slot array and free list live in a memory mapped file, open() maps it with no parsing, so startup is
+//O(1) and pages fault in lazily. T must be trivially copyable, the objects are the bytes in the file
+//inserts grow the file with ftruncate/mremap (read_write) or move the map to anonymous memory (copy_on_write)
+template<typename T,
+		 typename Mut = slot_internal::empty_mutex>
+struct mapped_slot_map {
+	static_assert(std::is_trivially_copyable<T>::value, "mapped_slot_map stores the bytes of T in a file");
+private:
+	typedef slot_internal::mapped_slot<T> slot_type;
+	typedef slot_internal::mapped_slot_map_header header_type;
+
+	static const size_t slot_offset = (sizeof(header_type) + alignof(slot_type) - 1) / alignof(slot_type) * alignof(slot_type);
+
+	Mut mtx;
+	mapped_slot_map_mode mode = mapped_read_only;
+	int fd = -1;
+	char* base = 0;
+	size_t mapped = 0;								//bytes mapped at base
+	bool anon = false;								//copy_on_write map that has grown, base is anonymous memory
+
+	static inline size_t file_size(size_t slots) {
+		return slot_offset + slots * sizeof(slot_type);
+	}
+	inline header_type* hdr() const {
+		return (header_type*)base;
+	}
+	inline slot_type* slots() const {
+		return (slot_type*)(base + slot_offset);
+	}
+
+	bool map_file(size_t bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+		int prot = mode == mapped_read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+		int flags = mode == mapped_read_write ? MAP_SHARED : MAP_PRIVATE;
+		void* ptr = mmap(0, bytes, prot, flags, fd, 0);
+		if(ptr == MAP_FAILED)
+			return false;
+		base = (char*)ptr;
+		mapped = bytes;
+		return true;
+#else
+		return false;
+#endif
+	}
+	bool remap(size_t bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+		if(mode == mapped_read_write) {
+			if(ftruncate(fd, bytes) != 0)
+				return false;
+#if defined(__linux__)
+			void* ptr = mremap(base, mapped, bytes, MREMAP_MAYMOVE);
+			if(ptr == MAP_FAILED)
+				return false;
+			base = (char*)ptr;
+			mapped = bytes;
+			return true;
+#else
+			munmap(base, mapped);
+			base = 0;
+			return map_file(bytes);
+#endif
+		}
+
+		//copy_on_write, the pages past the end of the file can't be private file pages, move everything to anonymous memory
+#if defined(__linux__)
+		if(anon) {
+			void* ptr = mremap(base, mapped, bytes, MREMAP_MAYMOVE);
+			if(ptr == MAP_FAILED)
+				return false;
+			base = (char*)ptr;
+			mapped = bytes;
+			return true;
+		}
+#endif
+		void* ptr = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(ptr == MAP_FAILED)
+			return false;
+		memcpy(ptr, base, mapped);
+		munmap(base, mapped);
+		base = (char*)ptr;
+		mapped = bytes;
+		anon = true;
+		return true;
+#else
+		return false;
+#endif
+	}
+	bool extend(size_t extnd) {
+		if(mode == mapped_read_only || extnd == 0)
+			return false;
+		size_t sze = hdr()->slots;
+		if(!remap(file_size(sze + extnd)))
+			return false;
+
+		//the new slots are zeroed (ftruncate/anonymous memory), push them onto the free list so the lowest is used first
+		slot_type* slts = slots();
+		uint64_t nxt = hdr()->firstslot;
+		for(size_t i = sze + extnd; i-- > sze;) {
+			slts[i].unn.next = nxt;
+			nxt = i;
+		}
+		hdr()->firstslot = nxt;
+		hdr()->slots = sze + extnd;
+		return true;
+	}
+	uint64_t get_next_free() {
+		if(hdr()->firstslot == slot_internal::mapped_slot_map_npos) {
+			//double the size
+			size_t sze = hdr()->slots;
+			if(!extend(sze < 16 ? 16 : sze))
+				return slot_internal::mapped_slot_map_npos;
+		}
+		uint64_t pos = hdr()->firstslot;
+		hdr()->firstslot = slots()[pos].unn.next;
+		++hdr()->count;
+		return pos;
+	}
+	slot_type* get_object_internal(const mapped_slot_map_handle& hdl) const {
+		if(base == 0 || hdl.idx >= hdr()->slots)
+			return 0;
+		slot_type* slt = slots() + hdl.idx;
+		return slt->valid && slt->gen == hdl.gen ? slt : 0;
+	}
+	void close_internal() {
+#if defined(__unix__) || defined(__APPLE__)
+		if(base)
+			munmap(base, mapped);
+		if(fd >= 0)
+			::close(fd);
+#endif
+		base = 0;
+		mapped = 0;
+		fd = -1;
+		anon = false;
+	}
+public:
+	mapped_slot_map() = default;
+	mapped_slot_map(const char* path, mapped_slot_map_mode md) {
+		open(path, md);
+	}
+	mapped_slot_map(const mapped_slot_map&) = delete;
+	mapped_slot_map& operator=(const mapped_slot_map&) = delete;
+	mapped_slot_map(mapped_slot_map&& rhs) {
+		*this = std::move(rhs);
+	}
+	mapped_slot_map& operator=(mapped_slot_map&& rhs) {
+		if(this == &rhs)
+			return *this;
+		close_internal();
+		mode = rhs.mode;
+		fd = rhs.fd;
+		base = rhs.base;
+		mapped = rhs.mapped;
+		anon = rhs.anon;
+		rhs.fd = -1;
+		rhs.base = 0;
+		rhs.mapped = 0;
+		rhs.anon = false;
+		return *this;
+	}
+	~mapped_slot_map() {
+		close_internal();
+	}
+
+	//map the file at path, with mapped_read_write a missing or empty file is created as an empty map
+	//returns false if the file can't be mapped or isn't a map of this T (the map is then closed)
+	bool open(const char* path, mapped_slot_map_mode md) {
+		lock();
+		close_internal();
+		mode = md;
+		bool rtn = false;
+#if defined(__unix__) || defined(__APPLE__)
+		fd = ::open(path, md == mapped_read_write ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+		struct stat st;
+		if(fd >= 0 && fstat(fd, &st) == 0) {
+			size_t sze = (size_t)st.st_size;
+			if(sze == 0 && md == mapped_read_write) {
+				//new map, just the header
+				if(ftruncate(fd, file_size(0)) == 0 && map_file(file_size(0))) {
+					memcpy(hdr()->magic, "SLOTMAP", 8);
+					hdr()->version = slot_internal::mapped_slot_map_version;
+					hdr()->tsize = sizeof(T);
+					hdr()->slots = 0;
+					hdr()->count = 0;
+					hdr()->firstslot = slot_internal::mapped_slot_map_npos;
+					rtn = true;
+				}
+			} else if(sze >= file_size(0) && map_file(sze)) {
+				header_type* h = hdr();
+				rtn = memcmp(h->magic, "SLOTMAP", 8) == 0 && h->version == slot_internal::mapped_slot_map_version &&
+					  h->tsize == sizeof(T) && h->slots <= (sze - slot_offset) / sizeof(slot_type) && h->count <= h->slots &&
+					  (h->firstslot < h->slots || h->firstslot == slot_internal::mapped_slot_map_npos);
+			}
+		}
+#endif
+		if(!rtn)
+			close_internal();
+		unlock();
+		return rtn;
+	}
+	void close() {
+		lock();
+		close_internal();
+		unlock();
+	}
+	inline bool is_open() const {
+		const_cast<mapped_slot_map<T, Mut>*>(this)->lock();
+		bool rtn = base != 0;
+		const_cast<mapped_slot_map<T, Mut>*>(this)->unlock();
+		return rtn;
+	}
+	//flush a read_write map to the file
+	bool sync() {
+		lock();
+		bool rtn = false;
+#if defined(__unix__) || defined(__APPLE__)
+		rtn = base != 0 && mode == mapped_read_write && msync(base, mapped, MS_SYNC) == 0;
+#endif
+		unlock();
+		return rtn;
+	}
+
+	void lock() {
+		mtx.lock();
+	}
+	void unlock() {
+		mtx.unlock();
+	}
+
+	//same as normal vector
+	typedef T value_type;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef T& reference;
+	typedef T const& const_reference;
+	typedef T* pointer;
+	typedef T const* const_pointer;
+	typedef mapped_slot_map_iterator<T, T> iterator;
+	typedef mapped_slot_map_iterator<T, const T> const_iterator;
+	typedef mapped_slot_map_handle handle;
+
+	// iterators:
+	//an insert that grows the map can move the mapping, iterators and object pointers are invalidated like a vector's
+	//(hold lock() around the use of them when other threads insert)
+	iterator begin() noexcept {
+		lock();
+		iterator rtn = base ? iterator(slots(), slots() + hdr()->slots) : iterator();
+		unlock();
+		return rtn;
+	}
+	inline const_iterator begin() const noexcept {
+		return const_cast<mapped_slot_map<T, Mut>*>(this)->begin();
+	}
+	iterator end() noexcept {
+		lock();
+		iterator rtn = base ? iterator(slots() + hdr()->slots, slots() + hdr()->slots) : iterator();
+		unlock();
+		return rtn;
+	}
+	inline const_iterator end() const noexcept {
+		return const_cast<mapped_slot_map<T, Mut>*>(this)->end();
+	}
+	inline const_iterator cbegin() const noexcept {
+		return begin();
+	}
+	inline const_iterator cend() const noexcept {
+		return end();
+	}
+
+	// capacity:
+	inline size_type size() const noexcept {
+		const_cast<mapped_slot_map<T, Mut>*>(this)->lock();
+		size_type rtn = base ? hdr()->count : 0;
+		const_cast<mapped_slot_map<T, Mut>*>(this)->unlock();
+		return rtn;
+	}
+	inline size_type capacity() const noexcept {
+		const_cast<mapped_slot_map<T, Mut>*>(this)->lock();
+		size_type rtn = base ? hdr()->slots : 0;
+		const_cast<mapped_slot_map<T, Mut>*>(this)->unlock();
+		return rtn;
+	}
+	inline bool empty() const noexcept {
+		return size() == 0;
+	}
+	bool reserve(size_type sz) {
+		lock();
+		bool rtn = base != 0 && (sz <= hdr()->slots || extend(sz - hdr()->slots));
+		unlock();
+		return rtn;
+	}
+
+	//an invalid handle if the map is read only or can't grow
+	handle insert(const T& val) {
+		lock();
+		handle rtn;
+		uint64_t pos = base && mode != mapped_read_only ? get_next_free() : slot_internal::mapped_slot_map_npos;
+		if(pos != slot_internal::mapped_slot_map_npos) {
+			slot_type& slt = slots()[pos];
+			memcpy(slt.unn.obj, &val, sizeof(T));
+			slt.valid = 1;
+			rtn.idx = pos;
+			rtn.gen = slt.gen;
+		}
+		unlock();
+		return rtn;
+	}
+
+	inline bool is_valid(const handle& hdl) const {
+		const_cast<mapped_slot_map<T, Mut>*>(this)->lock();
+		bool rtn = get_object_internal(hdl) != 0;
+		const_cast<mapped_slot_map<T, Mut>*>(this)->unlock();
+		return rtn;
+	}
+	//writing through the pointer of a read only map faults, the pointer is invalidated by an insert that grows the map
+	T* get_object(const handle& hdl) {
+		lock();
+		slot_type* slt = get_object_internal(hdl);
+		unlock();
+		return slt ? (T*)slt->unn.obj : 0;
+	}
+	inline const T* get_object(const handle& hdl) const {
+		return const_cast<mapped_slot_map<T, Mut>*>(this)->get_object(hdl);
+	}
+
+	bool erase(const handle& hdl) {
+		lock();
+		slot_type* slt = mode != mapped_read_only ? get_object_internal(hdl) : 0;
+		if(slt) {
+			slt->valid = 0;
+			++slt->gen;
+			slt->unn.next = hdr()->firstslot;
+			hdr()->firstslot = hdl.idx;
+			--hdr()->count;
+		}
+		unlock();
+		return slt != 0;
+	}
+	void clear() {
+		lock();
+		if(base && mode != mapped_read_only) {
+			//every handle goes stale, the free list is rebuilt lowest slot first
+			slot_type* slts = slots();
+			uint64_t nxt = slot_internal::mapped_slot_map_npos;
+			for(size_t i = hdr()->slots; i-- > 0;) {
+				if(slts[i].valid) {
+					slts[i].valid = 0;
+					++slts[i].gen;
+				}
+				slts[i].unn.next = nxt;
+				nxt = i;
+			}
+			hdr()->firstslot = nxt;
+			hdr()->count = 0;
+		}
+		unlock();
+	}
+};
+
+}
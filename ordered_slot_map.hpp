@@ -25,29 +25,38 @@
 \*----------------------------------------------------------------------------------*/
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
 #include <limits>
+#include <memory>
 #include <vector>
 #include <string.h>
+#include <type_traits>
+#include <utility>
 #include "slot_map_algorithm.hpp"
+#include "pool_allocator.hpp"
+#include "slot_map_btree.hpp"
 #include "empty_mutex.hpp"
 
 namespace std {
 
-template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc, typename KeyOf, typename Index, typename Compare>
 struct ordered_slot_map;
 
-template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc, typename KeyOf, typename Index, typename Compare>
 struct ordered_slot_map_iterator;
-template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc, typename KeyOf, typename Index, typename Compare>
 struct ordered_slot_map_const_iterator;
-template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc, typename KeyOf, typename Index, typename Compare>
 struct ordered_slot_map_reverse_iterator;
-template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc, typename KeyOf, typename Index, typename Compare>
 struct ordered_slot_map_const_reverse_iterator;
 
-template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc, typename KeyOf, typename Index, typename Compare>
 struct ordered_slot_map_weak_handle;
-template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc>
+template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc, typename KeyOf, typename Index, typename Compare>
 struct ordered_slot_map_handle;
 
 namespace slot_internal {
@@ -56,6 +65,28 @@ template<typename Mut = slot_internal::empty_mutex>
 struct ordered_slot_map_moon {
 	void* map = 0;
 	Mut mtx;
+	//the map holds one pin, a handle waiting on mtx holds another, the last one out frees the moon
+	std::atomic<size_t> pins{1};
+};
+
+//striped locks for the ordered_slot_map objects, an object locks the stripe its address hashes to
+//this keeps a Mut out of every object (40 bytes for std::recursive_mutex), objects sharing a stripe only add contention
+//as the mutex has to be recursive a thread locking two objects of one stripe is fine
+//lock order is map mutex then stripe, a handle holding a stripe lets go of it before it locks the map
+template<typename Mut>
+struct ordered_slot_map_lock_stripes {
+	static constexpr size_t stripes = 64;
+	struct alignas(64) stripe {
+		Mut mtx;
+	};
+
+	static Mut& get(const void* ptr) {
+		static stripe tbl[stripes];
+		//nodes are at least 16 byte aligned and packed in slabs, mix the bits above that
+		size_t h = (size_t)ptr;
+		h = (h >> 4) ^ (h >> 10) ^ (h >> 16);
+		return tbl[h % stripes].mtx;
+	}
 };
 
 template<typename T,
@@ -63,12 +94,16 @@ template<typename T,
 struct ordered_slot_map_object {
 	size_t strongcount = 0;
 	size_t weakcount = 0;
-	ordered_slot_map_moon<Mut>* moon = 0;
-	Mut mtx;
+	std::atomic<ordered_slot_map_moon<Mut>*> moon{nullptr};	//0 once the object is destroyed, handles read this without a lock
+	bool owned = false;								//the map owns this object, one of the strong counts is the map's
 	alignas(alignof(T)) char obj[sizeof(T)];
 
 	ordered_slot_map_object() = default;
 
+	inline Mut& mutex() const {
+		return ordered_slot_map_lock_stripes<Mut>::get(this);
+	}
+
 	//for completeness
 	ordered_slot_map_object(const ordered_slot_map_object& rhs) {
 		*(T*)obj = *(T*)rhs.obj;
@@ -95,70 +130,213 @@ struct ordered_slot_map_object {
 	}
 };
 
-template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc>
+//default key policy, no key is kept and every comparison dereferences the objects
+struct ordered_slot_map_no_key {};
+
+//entry in the sorted object list
+//with a key policy a copy of the sort key is kept next to the pointer, searches then run over the contiguous keys
+//and only dereference the objects when two keys are equal
+//KeyOf must preserve the order of the map's Compare, key(a) < key(b) must imply comp(a, b) and comp(a, b) must imply !(key(b) < key(a))
+template<typename T, typename Mut, typename KeyOf>
+struct ordered_slot_map_entry {
+	typedef typename std::decay<decltype(std::declval<KeyOf>()(std::declval<const T&>()))>::type key_type;
+
+	key_type key;
+	ordered_slot_map_object<T, Mut>* ptr = 0;
+
+	ordered_slot_map_entry() = default;
+	ordered_slot_map_entry(ordered_slot_map_object<T, Mut>* p)
+		: key(KeyOf()(*(const T*)p->obj)), ptr(p)
+	{}
+
+	template<typename Compare>
+	bool less(const ordered_slot_map_entry& rhs, const Compare& comp) const {
+		if(key < rhs.key)
+			return true;
+		else if(rhs.key < key)
+			return false;
+		//keys are equal, compare the objects
+		if(comp(*(T*)ptr->obj, *(T*)rhs.ptr->obj))
+			return true;
+		else if(comp(*(T*)rhs.ptr->obj, *(T*)ptr->obj))
+			return false;
+		//the two are equal, break ties using the allocated location
+		return ptr < rhs.ptr;
+	}
+	//less without the tie break, for entries already in order
+	template<typename Compare>
+	bool value_less(const ordered_slot_map_entry& rhs, const Compare& comp) const {
+		return key < rhs.key || (!(rhs.key < key) && comp(*(T*)ptr->obj, *(T*)rhs.ptr->obj));
+	}
+};
+
+template<typename T, typename Mut>
+struct ordered_slot_map_entry<T, Mut, ordered_slot_map_no_key> {
+	ordered_slot_map_object<T, Mut>* ptr = 0;
+
+	ordered_slot_map_entry() = default;
+	ordered_slot_map_entry(ordered_slot_map_object<T, Mut>* p)
+		: ptr(p)
+	{}
+
+	template<typename Compare>
+	bool less(const ordered_slot_map_entry& rhs, const Compare& comp) const {
+		if(comp(*(T*)ptr->obj, *(T*)rhs.ptr->obj))
+			return true;
+		else if(comp(*(T*)rhs.ptr->obj, *(T*)ptr->obj))
+			return false;
+		//the two are equal, break ties using the allocated location
+		return ptr < rhs.ptr;
+	}
+	template<typename Compare>
+	bool value_less(const ordered_slot_map_entry& rhs, const Compare& comp) const {
+		return comp(*(T*)ptr->obj, *(T*)rhs.ptr->obj);
+	}
+};
+
+//search probe for a plain value, the key of the value is taken once so a search compares keys like insert does
+template<typename T, typename Mut, typename KeyOf>
+struct ordered_slot_map_probe {
+	typename ordered_slot_map_entry<T, Mut, KeyOf>::key_type key;
+	const T& val;
+
+	ordered_slot_map_probe(const T& v)
+		: key(KeyOf()(v)), val(v)
+	{}
+
+	template<typename Compare>
+	inline bool greater(const ordered_slot_map_entry<T, Mut, KeyOf>& ent, const Compare& comp) const {
+		if(ent.key < key)
+			return true;
+		else if(key < ent.key)
+			return false;
+		return comp(*(const T*)ent.ptr->obj, val);
+	}
+	template<typename Compare>
+	inline bool less(const ordered_slot_map_entry<T, Mut, KeyOf>& ent, const Compare& comp) const {
+		if(key < ent.key)
+			return true;
+		else if(ent.key < key)
+			return false;
+		return comp(val, *(const T*)ent.ptr->obj);
+	}
+};
+
+template<typename T, typename Mut>
+struct ordered_slot_map_probe<T, Mut, ordered_slot_map_no_key> {
+	const T& val;
+
+	ordered_slot_map_probe(const T& v)
+		: val(v)
+	{}
+
+	template<typename Compare>
+	inline bool greater(const ordered_slot_map_entry<T, Mut, ordered_slot_map_no_key>& ent, const Compare& comp) const {
+		return comp(*(const T*)ent.ptr->obj, val);
+	}
+	template<typename Compare>
+	inline bool less(const ordered_slot_map_entry<T, Mut, ordered_slot_map_no_key>& ent, const Compare& comp) const {
+		return comp(val, *(const T*)ent.ptr->obj);
+	}
+};
+
+template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc, typename KeyOf, typename Index, typename Compare>
 struct internal_ordered_slot_map_handle {
 	ordered_slot_map_object<T, Mut>* ptr = 0;
 
 	ordered_slot_map_object<T, Mut>* get_obj() {
 		if(ptr == 0)
 			return 0;
-		ptr->mtx.lock();
+		ptr->mutex().lock();
 		if(ptr->strongcount == 0) {
 			--ptr->weakcount;
 			if(ptr->weakcount == 0) {
-				ptr->mtx.unlock();
+				ptr->mutex().unlock();
 				//deallocate the memory
 				ObjAlloc allctr;
 				allctr.deallocate(ptr, 1);
 			} else
-				ptr->mtx.unlock();
+				ptr->mutex().unlock();
 			ptr = 0;
 			return 0;
 		}
 		return ptr;
 	}
 	ordered_slot_map_object<T, Mut>* get_obj() const {
-		return const_cast<internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>*>(this)->get_obj();
+		return const_cast<internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->get_obj();
 	}
 	ordered_slot_map_object<T, Mut>* get_obj_nolock() {
 		if(ptr == 0)
 			return 0;
-		ptr->mtx.lock();
+		ptr->mutex().lock();
 		if(ptr->strongcount == 0) {
 			--ptr->weakcount;
 			if(ptr->weakcount == 0) {
-				ptr->mtx.unlock();
+				ptr->mutex().unlock();
 				//deallocate the memory
 				ObjAlloc allctr;
 				allctr.deallocate(ptr, 1);
 			} else
-				ptr->mtx.unlock();
+				ptr->mutex().unlock();
 			ptr = 0;
 			return 0;
 		}
-		ptr->mtx.unlock();
+		ptr->mutex().unlock();
 		return ptr;
 	}
 	ordered_slot_map_object<T, Mut>* get_obj_nolock() const {
-		return const_cast<internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>*>(this)->get_obj_nolock();
+		return const_cast<internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->get_obj_nolock();
+	}
+	//lock free dereference, the moon is cleared (under the object mutex) after the strong count reaches 0 so a non 0 moon
+	//is a live object. The count this handle holds keeps the node allocated, no hazard pointer or epoch is needed to read it
+	//only stale handles take the locked path, which lets go of them
+	ordered_slot_map_object<T, Mut>* get_obj_fast() {
+		if(ptr == 0)
+			return 0;
+		if(ptr->moon.load(std::memory_order_acquire) != 0)
+			return ptr;
+		return get_obj_nolock();
+	}
+	ordered_slot_map_object<T, Mut>* get_obj_fast() const {
+		return const_cast<internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->get_obj_fast();
 	}
 
 	void destruct_internal(bool strong) {
-		//notify the container
-		ptr->moon->mtx.lock();
-		((ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>*)ptr->moon->map)->erase_internal(ptr);
-		ptr->moon->mtx.unlock();
+		//notify the container, called with the object's stripe held
+		//the map takes its mutex before the stripes (clear, erase_if), so the stripe is let go, the map mutex taken and the
+		//stripe taken again. Meanwhile a temporary weak count keeps the node allocated and a pin keeps the moon, the moon
+		//can be read and pinned while the stripe is held as the map has to destroy this object (under the stripe) first
+		ordered_slot_map_moon<Mut>* mn = ptr->moon.load(std::memory_order_relaxed);
+		++ptr->weakcount;
+		mn->pins.fetch_add(1, std::memory_order_relaxed);
+		ptr->mutex().unlock();
+		mn->mtx.lock();
+		ptr->mutex().lock();
+		--ptr->weakcount;
+
+		//the map may have destroyed it meanwhile
+		if(ptr->moon.load(std::memory_order_relaxed) != 0) {
+			((ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*)mn->map)->erase_internal(ptr);
+
+			//actually do destruction
+			ptr->moon.store(0, std::memory_order_release);
+			((T*)ptr->obj)->~T();
+		}
+		mn->mtx.unlock();
 
-		//actually do destruction
-		ptr->moon = 0;
-		((T*)ptr->obj)->~T();
+		//the map may be gone too
+		if(mn->pins.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			mn->~ordered_slot_map_moon<Mut>();
+			MoonAlloc allctr;
+			allctr.deallocate(mn, 1);
+		}
 	}
 	void clear_internal(bool strong) {
 		//contact the owning object
 		if(ptr == 0)
 			return;
 		if(strong) {
-			ptr->mtx.lock();
+			ptr->mutex().lock();
 			if(ptr->strongcount != 0) {
 				--ptr->strongcount;
 				if(ptr->strongcount == 0)
@@ -166,28 +344,28 @@ struct internal_ordered_slot_map_handle {
 			} else
 				--ptr->weakcount;
 			if(ptr->weakcount == 0 && ptr->strongcount == 0) {
-				ptr->mtx.unlock();
+				ptr->mutex().unlock();
 				//deallocate the memory
 				ObjAlloc allctr;
 				allctr.deallocate(ptr, 1);
 				ptr = 0;
 				return;
 			}
-			ptr->mtx.unlock();
+			ptr->mutex().unlock();
 			ptr = 0;
 			return;
 		} else {
-			ptr->mtx.lock();
+			ptr->mutex().lock();
 			--ptr->weakcount;
 			if(ptr->weakcount == 0 && ptr->strongcount == 0) {
-				ptr->mtx.unlock();
+				ptr->mutex().unlock();
 				//deallocate the memory
 				ObjAlloc allctr;
 				allctr.deallocate(ptr, 1);
 				ptr = 0;
 				return;
 			}
-			ptr->mtx.unlock();
+			ptr->mutex().unlock();
 			ptr = 0;
 			return;
 		}
@@ -197,7 +375,7 @@ struct internal_ordered_slot_map_handle {
 		if(ptr == 0)
 			return;
 		if(strong) {
-			ptr->mtx.lock();
+			ptr->mutex().lock();
 			if(ptr->strongcount != 0) {
 				ptr->weakcount += ptr->strongcount - 1;
 				ptr->strongcount = 0;
@@ -205,18 +383,18 @@ struct internal_ordered_slot_map_handle {
 			} else
 				--ptr->weakcount;
 			if(ptr->weakcount == 0) {
-				ptr->mtx.unlock();
+				ptr->mutex().unlock();
 				//deallocate the memory
 				ObjAlloc allctr;
 				allctr.deallocate(ptr, 1);
 				ptr = 0;
 				return;
 			}
-			ptr->mtx.unlock();
+			ptr->mutex().unlock();
 			ptr = 0;
 			return;
 		} else {
-			ptr->mtx.lock();
+			ptr->mutex().lock();
 			--ptr->weakcount;
 			if(ptr->strongcount != 0) {
 				ptr->weakcount += ptr->strongcount;
@@ -224,14 +402,14 @@ struct internal_ordered_slot_map_handle {
 				destruct_internal(false);
 			}
 			if(ptr->weakcount == 0) {
-				ptr->mtx.unlock();
+				ptr->mutex().unlock();
 				//deallocate the memory
 				ObjAlloc allctr;
 				allctr.deallocate(ptr, 1);
 				ptr = 0;
 				return;
 			}
-			ptr->mtx.unlock();
+			ptr->mutex().unlock();
 			ptr = 0;
 			return;
 		}
@@ -244,25 +422,29 @@ template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*>::allocator_type,
 		 typename ObjAlloc = std::allocator<slot_internal::ordered_slot_map_object<T, Mut>>,
-		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>,
+		 typename KeyOf = slot_internal::ordered_slot_map_no_key,
+		 typename Index = slot_map_vector_index,
+		 typename Compare = std::less<T>>
 struct ordered_slot_map_iterator {
 private:
-	typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::iterator itr;
+	typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator itr;
 
-	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
-	friend struct ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
 	slot_internal::ordered_slot_map_object<T, Mut>* get_internal() {
-		return *itr;
+		return itr->ptr;
 	}
 
-	ordered_slot_map_iterator(const typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::iterator& it)
+	ordered_slot_map_iterator(const typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator& it)
 		: itr(it)
 	{}
 public:
+	typedef std::bidirectional_iterator_tag iterator_category;
 	typedef T value_type;
 	typedef size_t size_type;
 	typedef ptrdiff_t difference_type;
@@ -273,10 +455,10 @@ public:
 
 	ordered_slot_map_iterator() = default;
 	inline T& operator*() {
-		return *(T*)(*itr)->obj;
+		return *(T*)itr->ptr->obj;
 	}
 	inline T* operator->() {
-		return (T*)(*itr)->obj;
+		return (T*)itr->ptr->obj;
 	}
 	inline ordered_slot_map_iterator& operator++() {
 		++itr;
@@ -315,21 +497,21 @@ public:
 		return itr >= rhs.itr;
 	}
 
-	inline operator ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_iterator(itr));
+	inline operator ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_iterator(itr));
 	}
-	inline operator ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::reverse_iterator(itr));
+	inline operator ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::reverse_iterator(itr));
 	}
-	inline operator ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_reverse_iterator(itr));
+	inline operator ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_reverse_iterator(itr));
 	}
 
 	Mut* get_mutex() const {
-		return &const_cast<Mut>(itr->mtx);
+		return &itr->ptr->mutex();
 	}
 	Mut* get_mutex() {
-		return &const_cast<Mut>(itr->mtx);
+		return &itr->ptr->mutex();
 	}
 };
 
@@ -337,25 +519,29 @@ template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*>::allocator_type,
 		 typename ObjAlloc = std::allocator<slot_internal::ordered_slot_map_object<T, Mut>>,
-		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>,
+		 typename KeyOf = slot_internal::ordered_slot_map_no_key,
+		 typename Index = slot_map_vector_index,
+		 typename Compare = std::less<T>>
 struct ordered_slot_map_const_iterator {
 private:
-	typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_iterator itr;
+	typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_iterator itr;
 
-	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
-	friend struct ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
 	const slot_internal::ordered_slot_map_object<T, Mut>* get_internal() {
-		return *itr;
+		return itr->ptr;
 	}
 
-	ordered_slot_map_const_iterator(const typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_iterator& it)
+	ordered_slot_map_const_iterator(const typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_iterator& it)
 		: itr(it)
 	{}
 public:
+	typedef std::bidirectional_iterator_tag iterator_category;
 	typedef T value_type;
 	typedef size_t size_type;
 	typedef ptrdiff_t difference_type;
@@ -366,10 +552,10 @@ public:
 
 	ordered_slot_map_const_iterator() = default;
 	inline const T& operator*() {
-		return *(const T*)(*itr)->obj;
+		return *(const T*)itr->ptr->obj;
 	}
 	inline const T* operator->() {
-		return (const T*)(*itr)->obj;
+		return (const T*)itr->ptr->obj;
 	}
 	inline ordered_slot_map_const_iterator& operator++() {
 		++itr;
@@ -408,21 +594,21 @@ public:
 		return itr >= rhs.itr;
 	}
 
-	inline operator ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::iterator(itr));
+	inline operator ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator(itr));
 	}
-	inline operator ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::reverse_iterator(itr));
+	inline operator ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::reverse_iterator(itr));
 	}
-	inline operator ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_reverse_iterator(itr));
+	inline operator ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_reverse_iterator(itr));
 	}
 
 	Mut* get_mutex() const {
-		return &const_cast<Mut>(itr->mtx);
+		return &itr->ptr->mutex();
 	}
 	Mut* get_mutex() {
-		return &const_cast<Mut>(itr->mtx);
+		return &itr->ptr->mutex();
 	}
 };
 
@@ -430,25 +616,29 @@ template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*>::allocator_type,
 		 typename ObjAlloc = std::allocator<slot_internal::ordered_slot_map_object<T, Mut>>,
-		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>,
+		 typename KeyOf = slot_internal::ordered_slot_map_no_key,
+		 typename Index = slot_map_vector_index,
+		 typename Compare = std::less<T>>
 struct ordered_slot_map_reverse_iterator {
 private:
-	typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::reverse_iterator itr;
+	typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::reverse_iterator itr;
 
-	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
-	friend struct ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
 	slot_internal::ordered_slot_map_object<T, Mut>* get_internal() {
-		return *itr;
+		return itr->ptr;
 	}
 
-	ordered_slot_map_reverse_iterator(const typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::reverse_iterator& it)
+	ordered_slot_map_reverse_iterator(const typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::reverse_iterator& it)
 		: itr(it)
 	{}
 public:
+	typedef std::bidirectional_iterator_tag iterator_category;
 	typedef T value_type;
 	typedef size_t size_type;
 	typedef ptrdiff_t difference_type;
@@ -459,10 +649,10 @@ public:
 
 	ordered_slot_map_reverse_iterator() = default;
 	inline T& operator*() {
-		return *(T*)(*itr)->obj;
+		return *(T*)itr->ptr->obj;
 	}
 	inline T* operator->() {
-		return (T*)(*itr)->obj;
+		return (T*)itr->ptr->obj;
 	}
 	inline ordered_slot_map_reverse_iterator& operator++() {
 		++itr;
@@ -501,21 +691,21 @@ public:
 		return itr >= rhs.itr;
 	}
 
-	inline operator ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::iterator(itr));
+	inline operator ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator(itr));
 	}
-	inline operator ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_iterator(itr));
+	inline operator ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_iterator(itr));
 	}
-	inline operator ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_reverse_iterator(itr));
+	inline operator ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_reverse_iterator(itr));
 	}
 
 	Mut* get_mutex() const {
-		return &const_cast<Mut>(itr->mtx);
+		return &itr->ptr->mutex();
 	}
 	Mut* get_mutex() {
-		return &const_cast<Mut>(itr->mtx);
+		return &itr->ptr->mutex();
 	}
 };
 
@@ -523,25 +713,29 @@ template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*>::allocator_type,
 		 typename ObjAlloc = std::allocator<slot_internal::ordered_slot_map_object<T, Mut>>,
-		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>>
+		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>,
+		 typename KeyOf = slot_internal::ordered_slot_map_no_key,
+		 typename Index = slot_map_vector_index,
+		 typename Compare = std::less<T>>
 struct ordered_slot_map_const_reverse_iterator {
 private:
-	typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_reverse_iterator itr;
+	typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_reverse_iterator itr;
 
-	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
-	friend struct ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
 	const slot_internal::ordered_slot_map_object<T, Mut>* get_internal() {
-		return *itr;
+		return itr->ptr;
 	}
 
-	ordered_slot_map_const_reverse_iterator(const typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_reverse_iterator& it)
+	ordered_slot_map_const_reverse_iterator(const typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_reverse_iterator& it)
 		: itr(it)
 	{}
 public:
+	typedef std::bidirectional_iterator_tag iterator_category;
 	typedef T value_type;
 	typedef size_t size_type;
 	typedef ptrdiff_t difference_type;
@@ -552,10 +746,10 @@ public:
 
 	ordered_slot_map_const_reverse_iterator() = default;
 	inline const T& operator*() {
-		return *(const T*)(*itr)->obj;
+		return *(const T*)itr->ptr->obj;
 	}
 	inline const T* operator->() {
-		return (const T*)(*itr)->obj;
+		return (const T*)itr->ptr->obj;
 	}
 	inline ordered_slot_map_const_reverse_iterator& operator++() {
 		++itr;
@@ -594,21 +788,21 @@ public:
 		return itr >= rhs.itr;
 	}
 
-	inline operator ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::iterator(itr));
+	inline operator ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator(itr));
 	}
-	inline operator ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::const_iterator(itr));
+	inline operator ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::const_iterator(itr));
 	}
-	inline operator ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>() const {
-		return ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>(typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::reverse_iterator(itr));
+	inline operator ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>() const {
+		return ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>(typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::reverse_iterator(itr));
 	}
 
 	Mut* get_mutex() const {
-		return &const_cast<Mut>(itr->mtx);
+		return &itr->ptr->mutex();
 	}
 	Mut* get_mutex() {
-		return &const_cast<Mut>(itr->mtx);
+		return &itr->ptr->mutex();
 	}
 };
 
@@ -616,11 +810,14 @@ template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*>::allocator_type,
 		 typename ObjAlloc = std::allocator<slot_internal::ordered_slot_map_object<T, Mut>>,
-		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>>
-struct ordered_slot_map_handle : slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> {
+		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>,
+		 typename KeyOf = slot_internal::ordered_slot_map_no_key,
+		 typename Index = slot_map_vector_index,
+		 typename Compare = std::less<T>>
+struct ordered_slot_map_handle : slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> {
 	ordered_slot_map_handle() = default;
 
-	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
 	ordered_slot_map_handle(const ordered_slot_map_handle& rhs) {
 		//copy this
@@ -628,7 +825,7 @@ struct ordered_slot_map_handle : slot_internal::internal_ordered_slot_map_handle
 		if(rslt) {
 			++rslt->strongcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 	}
 	ordered_slot_map_handle(ordered_slot_map_handle&& rhs) {
@@ -637,23 +834,23 @@ struct ordered_slot_map_handle : slot_internal::internal_ordered_slot_map_handle
 		rhs.ptr = 0;
 	}
 
-	ordered_slot_map_handle(const ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& rhs) {
+	ordered_slot_map_handle(const ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& rhs) {
 		//copy this
 		slot_internal::ordered_slot_map_object<T, Mut>* rslt = rhs.get_obj();
 		if(rslt) {
 			++rslt->strongcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 	}
-	ordered_slot_map_handle(ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&& rhs) {
+	ordered_slot_map_handle(ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>&& rhs) {
 		//move this
 		slot_internal::ordered_slot_map_object<T, Mut>* rslt = rhs.get_obj();
 		if(rslt) {
 			++rslt->strongcount;
 			--rslt->weakcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 		rhs.ptr = 0;
 	}
@@ -668,7 +865,7 @@ struct ordered_slot_map_handle : slot_internal::internal_ordered_slot_map_handle
 		if(rslt) {
 			++rslt->strongcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 		return *this;
 	}
@@ -685,7 +882,7 @@ struct ordered_slot_map_handle : slot_internal::internal_ordered_slot_map_handle
 		return *this;
 	}
 
-	ordered_slot_map_handle& operator=(const ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& rhs) {
+	ordered_slot_map_handle& operator=(const ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& rhs) {
 		if(this->ptr == rhs.ptr)
 			return *this;
 		//copy this
@@ -695,11 +892,11 @@ struct ordered_slot_map_handle : slot_internal::internal_ordered_slot_map_handle
 		if(rslt) {
 			++rslt->strongcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 		return *this;
 	}
-	ordered_slot_map_handle& operator=(ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&& rhs) {
+	ordered_slot_map_handle& operator=(ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>&& rhs) {
 		if(this->ptr == rhs.ptr) {
 			rhs.clear();
 			return *this;
@@ -712,7 +909,7 @@ struct ordered_slot_map_handle : slot_internal::internal_ordered_slot_map_handle
 			++rslt->strongcount;
 			--rslt->weakcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 		rhs.ptr = 0;
 		return *this;
@@ -731,31 +928,31 @@ struct ordered_slot_map_handle : slot_internal::internal_ordered_slot_map_handle
 	}
 
 	Mut* get_mutex() const {
-		return &this->get_obj_nolock()->mtx;
+		return &this->get_obj_nolock()->mutex();
 	}
 	Mut* get_mutex() {
-		return &this->get_obj_nolock()->mtx;
+		return &this->get_obj_nolock()->mutex();
 	}
 
 	inline T& operator*() {
-		return *(T*)this->get_obj_nolock()->obj;
+		return *(T*)this->get_obj_fast()->obj;
 	}
 	inline T* operator->() {
-		return (T*)this->get_obj_nolock()->obj;
+		return (T*)this->get_obj_fast()->obj;
 	}
 
 	inline const T& operator*() const {
-		return *(const T*)this->get_obj_nolock()->obj;
+		return *(const T*)this->get_obj_fast()->obj;
 	}
 	inline const T* operator->() const {
-		return (const T*)this->get_obj_nolock()->obj;
+		return (const T*)this->get_obj_fast()->obj;
 	}
 
 	inline operator T*() {
-		return (T*)this->get_obj_nolock()->obj;
+		return (T*)this->get_obj_fast()->obj;
 	}
 	inline operator const T*() const {
-		return (const T*)this->get_obj_nolock()->obj;
+		return (const T*)this->get_obj_fast()->obj;
 	}
 };
 
@@ -763,11 +960,14 @@ template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*>::allocator_type,
 		 typename ObjAlloc = std::allocator<slot_internal::ordered_slot_map_object<T, Mut>>,
-		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>>
-struct ordered_slot_map_weak_handle : slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> {
+		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>,
+		 typename KeyOf = slot_internal::ordered_slot_map_no_key,
+		 typename Index = slot_map_vector_index,
+		 typename Compare = std::less<T>>
+struct ordered_slot_map_weak_handle : slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> {
 	ordered_slot_map_weak_handle() = default;
 
-	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
 	ordered_slot_map_weak_handle(const ordered_slot_map_weak_handle& rhs) {
 		//copy this
@@ -775,7 +975,7 @@ struct ordered_slot_map_weak_handle : slot_internal::internal_ordered_slot_map_h
 		if(rslt) {
 			++rslt->weakcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 	}
 	ordered_slot_map_weak_handle(ordered_slot_map_weak_handle&& rhs) {
@@ -784,16 +984,16 @@ struct ordered_slot_map_weak_handle : slot_internal::internal_ordered_slot_map_h
 		rhs.ptr = 0;
 	}
 
-	ordered_slot_map_weak_handle(const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& rhs) {
+	ordered_slot_map_weak_handle(const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& rhs) {
 		//copy this
 		slot_internal::ordered_slot_map_object<T, Mut>* rslt = rhs.get_obj();
 		if(rslt) {
 			++rslt->weakcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 	}
-	ordered_slot_map_weak_handle(ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&& rhs) {
+	ordered_slot_map_weak_handle(ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>&& rhs) {
 		//move this
 		slot_internal::ordered_slot_map_object<T, Mut>* rslt = rhs.get_obj();
 		if(rslt) {
@@ -802,18 +1002,18 @@ struct ordered_slot_map_weak_handle : slot_internal::internal_ordered_slot_map_h
 			if(rslt->strongcount == 0) {
 				this->destruct_internal(false);
 				if(rslt->weakcount == 0) {
-					rslt->mtx.unlock();
+					rslt->mutex().unlock();
 					//deallocate the memory
 					ObjAlloc allctr;
 					allctr.deallocate(rslt, 1);
 				} else
-					rslt->mtx.unlock();
+					rslt->mutex().unlock();
 				rhs.ptr = 0;
 				this->ptr = 0;
 				return;
 			}
 			++rslt->weakcount;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 		rhs.ptr = 0;
 	}
@@ -828,7 +1028,7 @@ struct ordered_slot_map_weak_handle : slot_internal::internal_ordered_slot_map_h
 		if(rslt) {
 			++rslt->weakcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 		return *this;
 	}
@@ -845,22 +1045,22 @@ struct ordered_slot_map_weak_handle : slot_internal::internal_ordered_slot_map_h
 		return *this;
 	}
 
-	ordered_slot_map_weak_handle& operator=(const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& rhs) {
+	ordered_slot_map_weak_handle& operator=(const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& rhs) {
 		//copy this
 		if(this->ptr == rhs.ptr)
 			return *this;
 		clear();
 
-		slot_internal::ordered_slot_map_object<T, Mut>* rslt = rhs.get_internal_ptr();
+		slot_internal::ordered_slot_map_object<T, Mut>* rslt = rhs.get_obj();
 		if(rslt) {
 			++rslt->weakcount;
 			this->ptr = rslt;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 
 		return *this;
 	}
-	ordered_slot_map_weak_handle& operator=(ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&& rhs) {
+	ordered_slot_map_weak_handle& operator=(ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>&& rhs) {
 		//move this
 		if(this->ptr == rhs.ptr) {
 			rhs.clear();
@@ -875,18 +1075,18 @@ struct ordered_slot_map_weak_handle : slot_internal::internal_ordered_slot_map_h
 			if(rslt->strongcount == 0) {
 				this->destruct_internal(false);
 				if(rslt->weakcount == 0) {
-					rslt->mtx.unlock();
+					rslt->mutex().unlock();
 					//deallocate the memory
 					ObjAlloc allctr;
 					allctr.deallocate(rslt, 1);
 				} else
-					rslt->mtx.unlock();
+					rslt->mutex().unlock();
 				rhs.ptr = 0;
 				this->ptr = 0;
 				return *this;
 			}
 			++rslt->weakcount;
-			rslt->mtx.unlock();
+			rslt->mutex().unlock();
 		}
 		rhs.ptr = 0;
 		return *this;
@@ -905,31 +1105,31 @@ struct ordered_slot_map_weak_handle : slot_internal::internal_ordered_slot_map_h
 	}
 
 	Mut* get_mutex() const {
-		return &this->get_obj_nolock()->mtx;
+		return &this->get_obj_nolock()->mutex();
 	}
 	Mut* get_mutex() {
-		return &this->get_obj_nolock()->mtx;
+		return &this->get_obj_nolock()->mutex();
 	}
 
 	inline T& operator*() {
-		return *(T*)this->get_obj_nolock()->obj;
+		return *(T*)this->get_obj_fast()->obj;
 	}
 	inline T* operator->() {
-		return (T*)this->get_obj_nolock()->obj;
+		return (T*)this->get_obj_fast()->obj;
 	}
 
 	inline const T& operator*() const {
-		return *(const T*)this->get_obj_nolock()->obj;
+		return *(const T*)this->get_obj_fast()->obj;
 	}
 	inline const T* operator->() const {
-		return (const T*)this->get_obj_nolock()->obj;
+		return (const T*)this->get_obj_fast()->obj;
 	}
 
 	inline operator T*() {
-		return (T*)this->get_obj_nolock()->obj;
+		return (T*)this->get_obj_fast()->obj;
 	}
 	inline operator const T*() const {
-		return (const T*)this->get_obj_nolock()->obj;
+		return (const T*)this->get_obj_fast()->obj;
 	}
 };
 
@@ -937,24 +1137,28 @@ template<typename T,
 		 typename Mut = slot_internal::empty_mutex,
 		 typename Alloc = typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*>::allocator_type,
 		 typename ObjAlloc = std::allocator<slot_internal::ordered_slot_map_object<T, Mut>>,
-		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>>
-struct ordered_slot_map {
+		 typename MoonAlloc = std::allocator<slot_internal::ordered_slot_map_moon<Mut>>,
+		 typename KeyOf = slot_internal::ordered_slot_map_no_key,
+		 typename Index = slot_map_vector_index,
+		 typename Compare = std::less<T>>
+struct ordered_slot_map : private slot_internal::compare_holder<Compare> {
 private:
 	typedef typename slot_internal::ordered_slot_map_moon<Mut> MoonType;
 
 	MoonType* moon = 0;
-	std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc> objs;
-	std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>, Alloc> store;
+	typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type objs;
+	std::shared_ptr<const std::vector<T>> snap;						//last snapshot, dropped by anything that changes the contents
+	std::shared_ptr<const slot_internal::eytzinger_index<T>> search;	//search copy of the last snapshot, dropped with it
 
-	friend struct ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
-	friend struct ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
-	friend struct ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
+	friend struct ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
-	friend struct slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>;
+	friend struct slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>;
 
 	void initMoon() {
 		//set the moon
@@ -964,11 +1168,13 @@ private:
 		moon->map = this;
 	}
 	void dtorMoon() {
-		//destruct the moon if we have one
+		//destruct the moon if we have one, unless a handle destroying an object has it pinned
 		if(moon) {
-			moon->~MoonType();
-			MoonAlloc allctr;
-			allctr.deallocate(moon, 1);
+			if(moon->pins.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				moon->~MoonType();
+				MoonAlloc allctr;
+				allctr.deallocate(moon, 1);
+			}
 			moon = 0;
 		}
 	}
@@ -983,28 +1189,58 @@ public:
 	ordered_slot_map() {
 		initMoon();
 	}
-	ordered_slot_map(const ordered_slot_map& rhs) {
+	explicit ordered_slot_map(const Compare& comp)
+		: slot_internal::compare_holder<Compare>(comp) {
+		initMoon();
+	}
+	ordered_slot_map(const ordered_slot_map& rhs)
+		: slot_internal::compare_holder<Compare>(rhs.get_compare()) {
 		initMoon();
 		*this = rhs;
 	}
-	ordered_slot_map(ordered_slot_map&& rhs) {
+	ordered_slot_map(ordered_slot_map&& rhs)
+		: slot_internal::compare_holder<Compare>(rhs.get_compare()) {
 		*this = std::move(rhs);
 	}
+	//bulk build, the map owns every object, see assign
+	template<typename Itr>
+	ordered_slot_map(Itr begin, Itr end, const Compare& comp = Compare())
+		: slot_internal::compare_holder<Compare>(comp) {
+		initMoon();
+		build_internal(begin, end);
+	}
 
 	ordered_slot_map& operator=(const ordered_slot_map& rhs) {
 		if(this == &rhs)
 			return *this;
 		//clear this
 		clear_internal();
-
-		//copy everything across
-		for(auto it = rhs.objs.begin(); it != rhs.objs.end(); ++it) {
-			ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> hdl;
-			hdl.ptr = *it;
-			bool owner = rhs.owns_internal(hdl);
-			insert_internal((*(T*)(*it)->obj), owner);
-			memset((void*)&hdl, 0, sizeof(ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>));
+		this->set_compare(rhs.get_compare());
+
+		//copy the owned objects across, the others have no handle in this copy and would be destroyed straight away
+		//handles point at nodes bound to one map, so the copy has its own nodes, O(n) as rhs is already in order
+		std::vector<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>> batch;
+		batch.reserve(rhs.objs.size());
+		for(auto it = rhs.objs.begin(); it != rhs.objs.end(); ++it)
+			if(it->ptr->owned)
+				batch.push_back(slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>(new_owned_object(*(const T*)it->ptr->obj)));
+		//equal objects are ordered by node address, only runs of them need sorting again
+		for(size_t b = 0; b < batch.size();) {
+			size_t e = b + 1;
+			while(e < batch.size() && !batch[e - 1].value_less(batch[e], this->get_compare()))
+				++e;
+			if(e - b > 1)
+				std::sort(batch.begin() + b, batch.begin() + e,
+					[](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& x, const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& y) {
+						return x.ptr < y.ptr;
+					});
+			b = e;
 		}
+		objs.assign(batch.begin(), batch.end());
+		contents_changed();
+		//same values in the same order, read only consumers of the copy keep using the snapshot rhs already made
+		if(batch.size() == rhs.objs.size())
+			snap = rhs.snap;
 		return *this;
 	}
 	ordered_slot_map& operator=(ordered_slot_map&& rhs) {
@@ -1017,8 +1253,17 @@ public:
 		moveMoon(rhs);
 
 		//move everything across
-		store = std::move(store);
-		objs = std::move(objs);
+		this->set_compare(rhs.get_compare());
+		objs = std::move(rhs.objs);
+		snap = std::move(rhs.snap);
+		search = std::move(rhs.search);
+		moon->map = this;
+
+		//leave rhs empty but usable
+		rhs.objs.clear();
+		rhs.snap.reset();
+		rhs.search.reset();
+		rhs.initMoon();
 		return *this;
 	}
 
@@ -1038,99 +1283,94 @@ public:
 	typedef T const& const_reference;
 	typedef T* pointer;
 	typedef T const* const_pointer;
-	typedef ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc> iterator;
-	typedef ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc> const_iterator;
-	typedef ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc> reverse_iterator;
-	typedef ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc> const_reverse_iterator;
-	typedef ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> handle;
-	typedef ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> weak_handle;
+	typedef ordered_slot_map_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> iterator;
+	typedef ordered_slot_map_const_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> const_iterator;
+	typedef ordered_slot_map_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> reverse_iterator;
+	typedef ordered_slot_map_const_reverse_iterator<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> const_reverse_iterator;
+	typedef ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> handle;
+	typedef ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> weak_handle;
+	typedef Compare key_compare;
+	typedef Compare value_compare;
 private:
 
 	void destruct_internal(slot_internal::ordered_slot_map_object<T, Mut>* ptr) noexcept {
 		//lock this object
-		ptr->mtx.lock();
+		ptr->mutex().lock();
 		ptr->weakcount += ptr->strongcount;
 		ptr->strongcount = 0;
 		//call destructor on this!
-		ptr->moon = 0;
+		ptr->moon.store(0, std::memory_order_release);
 		((T*)ptr->obj)->~T();
-		ptr->mtx.unlock();
+		ptr->mutex().unlock();
+	}
+	void drop_ownership(slot_internal::ordered_slot_map_object<T, Mut>* ptr) noexcept {
+		//after destruct_internal the map's strong count is one of the weak counts, give it up
+		ptr->mutex().lock();
+		if(!ptr->owned) {
+			ptr->mutex().unlock();
+			return;
+		}
+		ptr->owned = false;
+		--ptr->weakcount;
+		if(ptr->weakcount == 0) {
+			ptr->mutex().unlock();
+			//deallocate the memory
+			ObjAlloc allctr;
+			allctr.deallocate(ptr, 1);
+			return;
+		}
+		ptr->mutex().unlock();
 	}
 	void clear_internal() noexcept {
-		//empty everything out, go through and  all of the
-		for(unsigned i = 0; i < objs.size(); ++i)
-			destruct_internal(objs[i]);
-
-		//clear store first, this should clear objs
-		store.clear();
+		//empty everything out, destroy every object and let go of the owned ones
+		for(auto it = objs.begin(); it != objs.end(); ++it) {
+			destruct_internal(it->ptr);
+			drop_ownership(it->ptr);
+		}
 		objs.clear();
+		contents_changed();
 	}
 	void erase_internal(slot_internal::ordered_slot_map_object<T, Mut>* ptr) {
 		{
 			//find in objs
-			//std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc> objs;
-			typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::iterator out;
-			bool found = slot_internal::binary_search(objs.begin(), objs.end(), ptr,
-									 [](slot_internal::ordered_slot_map_object<T, Mut>* a,
-										slot_internal::ordered_slot_map_object<T, Mut>* b) {
-											if((*(T*)a->obj) < (*(T*)b->obj))
-												return true;
-											else if((*(T*)b->obj) < (*(T*)a->obj))
-												return false;
-											//the two are equal, break ties using the allocated location
-											return a < b;
+			//typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type objs;
+			typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator out;
+			bool found = slot_internal::binary_search(objs, slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>(ptr),
+									 [this](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a,
+										const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& b) {
+											return a.less(b, this->get_compare());
 									 }, out);
 			if(found)
 				objs.erase(out);
+			contents_changed();
 		}
 
-		{
-			//if this is in store, delete from there too
-			typename std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>, Alloc>::iterator out;
-			ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> tmp;
-			tmp.ptr = ptr;
-			bool found = slot_internal::binary_search(store.begin(), store.end(), tmp,
-									 [](const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& a,
-										const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& b) {
-											return a.ptr < b.ptr;
-									 }, out);
-			//clear without destruction!
-			memset((void*)&tmp, 0, sizeof(ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>));
-			if(found)
-				store.erase(out);
+		//the object is being destroyed by a handle (its mutex is held), the map's strong count was turned into a weak count
+		//with the others, drop it here and the handle frees the object once the weak counts reach 0
+		if(ptr->owned) {
+			ptr->owned = false;
+			--ptr->weakcount;
 		}
 	}
 	void insert(slot_internal::ordered_slot_map_object<T, Mut>* ptr, bool owner) {
 		{
 			//add this into objs
-			//std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc> objs;
-			typename std::vector<slot_internal::ordered_slot_map_object<T, Mut>*, Alloc>::iterator out;
-			slot_internal::binary_search(objs.begin(), objs.end(), ptr,
-						 [](slot_internal::ordered_slot_map_object<T, Mut>* a,
-							slot_internal::ordered_slot_map_object<T, Mut>* b) {
-								if((*(T*)a->obj) < (*(T*)b->obj))
-									return true;
-								else if((*(T*)b->obj) < (*(T*)a->obj))
-									return false;
-								//the two are equal, break ties using the allocated location
-								return a < b;
+			//typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type objs;
+			typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator out;
+			slot_internal::ordered_slot_map_entry<T, Mut, KeyOf> ent(ptr);
+			slot_internal::binary_search(objs, ent,
+						 [this](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a,
+							const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& b) {
+								return a.less(b, this->get_compare());
 						 }, out);
-			objs.insert(out, ptr);
+			objs.insert(out, ent);
+			contents_changed();
 		}
 
 		if(owner) {
-			//if we are to own this then added it into store too
-			//std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>, Alloc> store;
-			typename std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>, Alloc>::iterator out;
-			ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> tmp;
-			tmp.ptr = ptr;
+			//the map keeps a strong count
+			ptr->owned = true;
 			++ptr->strongcount;
-			slot_internal::binary_search(store.begin(), store.end(), tmp,
-							[](const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& a,
-							   const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& b) {
-								return a.ptr < b.ptr;
-							}, out);
-			store.insert(out, std::move(tmp));
 		}
 	}
 public:
@@ -1176,9 +1416,9 @@ public:
 
 	// capacity:
 	inline size_type size() const noexcept {
-		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>*>(this)->lock();
+		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->lock();
 		size_type rtn = objs.size();
-		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>*>(this)->unlock();
+		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->unlock();
 		return rtn;
 	}
 	inline size_type max_size() const noexcept {
@@ -1188,9 +1428,9 @@ public:
 		//do nothing
 	}
 	inline size_type capacity() const noexcept {
-		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>*>(this)->lock();
+		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->lock();
 		size_type rtn = objs.capacity();
-		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>*>(this)->unlock();
+		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->unlock();
 		return rtn;
 	}
 	void reserve(size_type sz) {
@@ -1212,7 +1452,222 @@ public:
 	}
 
 private:
-	ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> insert_internal(const T& val, bool owner) {
+	typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator lower_bound_internal(const T& val) {
+		slot_internal::ordered_slot_map_probe<T, Mut, KeyOf> prb(val);
+		return slot_internal::sequence_lower_bound(objs, prb,
+			[this](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a,
+			   const slot_internal::ordered_slot_map_probe<T, Mut, KeyOf>& b) {
+				return b.greater(a, this->get_compare());
+			});
+	}
+	typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator upper_bound_internal(const T& val) {
+		//first object the value is less than
+		slot_internal::ordered_slot_map_probe<T, Mut, KeyOf> prb(val);
+		return slot_internal::sequence_lower_bound(objs, prb,
+			[this](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a,
+			   const slot_internal::ordered_slot_map_probe<T, Mut, KeyOf>& b) {
+				return !b.less(a, this->get_compare());
+			});
+	}
+	template<typename K, typename Less>
+	typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator lower_bound_internal(const K& key, Less comp) {
+		//a foreign key can't be compared with the stored sort keys, compare the objects
+		return slot_internal::sequence_lower_bound(objs, key,
+			[&comp](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a, const K& b) {
+				return comp(*(const T*)a.ptr->obj, b);
+			});
+	}
+	template<typename K, typename Less>
+	typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator upper_bound_internal(const K& key, Less comp) {
+		return slot_internal::sequence_lower_bound(objs, key,
+			[&comp](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a, const K& b) {
+				return !comp(b, *(const T*)a.ptr->obj);
+			});
+	}
+public:
+	// lookup:
+	iterator lower_bound(const T& val) {
+		lock();
+		iterator rtn(lower_bound_internal(val));
+		unlock();
+		return rtn;
+	}
+	iterator upper_bound(const T& val) {
+		lock();
+		iterator rtn(upper_bound_internal(val));
+		unlock();
+		return rtn;
+	}
+	std::pair<iterator, iterator> equal_range(const T& val) {
+		lock();
+		std::pair<iterator, iterator> rtn(iterator(lower_bound_internal(val)), iterator(upper_bound_internal(val)));
+		unlock();
+		return rtn;
+	}
+	iterator find(const T& val) {
+		lock();
+		typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator out = lower_bound_internal(val);
+		if(out != objs.end() && this->get_compare()(val, *(const T*)out->ptr->obj))
+			out = objs.end();
+		iterator rtn(out);
+		unlock();
+		return rtn;
+	}
+
+	inline const_iterator lower_bound(const T& val) const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->lower_bound(val);
+	}
+	inline const_iterator upper_bound(const T& val) const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->upper_bound(val);
+	}
+	inline std::pair<const_iterator, const_iterator> equal_range(const T& val) const {
+		std::pair<iterator, iterator> rtn = const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->equal_range(val);
+		return std::pair<const_iterator, const_iterator>(rtn.first, rtn.second);
+	}
+	inline const_iterator find(const T& val) const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->find(val);
+	}
+
+	//heterogeneous lookup by a key, like std::set with std::less<>, no temporary T is built for the probes
+	//Less must declare is_transparent, accept (T, K) and (K, T) and order the keys like Compare orders the objects
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	iterator lower_bound(const K& key, Less comp) {
+		lock();
+		iterator rtn(lower_bound_internal(key, comp));
+		unlock();
+		return rtn;
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	iterator upper_bound(const K& key, Less comp) {
+		lock();
+		iterator rtn(upper_bound_internal(key, comp));
+		unlock();
+		return rtn;
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	std::pair<iterator, iterator> equal_range(const K& key, Less comp) {
+		lock();
+		std::pair<iterator, iterator> rtn(iterator(lower_bound_internal(key, comp)), iterator(upper_bound_internal(key, comp)));
+		unlock();
+		return rtn;
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	iterator find(const K& key, Less comp) {
+		lock();
+		typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator out = lower_bound_internal(key, comp);
+		if(out != objs.end() && comp(key, *(const T*)out->ptr->obj))
+			out = objs.end();
+		iterator rtn(out);
+		unlock();
+		return rtn;
+	}
+
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	inline const_iterator lower_bound(const K& key, Less comp) const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->lower_bound(key, comp);
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	inline const_iterator upper_bound(const K& key, Less comp) const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->upper_bound(key, comp);
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	inline std::pair<const_iterator, const_iterator> equal_range(const K& key, Less comp) const {
+		std::pair<iterator, iterator> rtn = const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->equal_range(key, comp);
+		return std::pair<const_iterator, const_iterator>(rtn.first, rtn.second);
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	inline const_iterator find(const K& key, Less comp) const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->find(key, comp);
+	}
+
+	//heterogeneous lookup with the stored comparison, only when Compare is transparent
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline iterator lower_bound(const K& key) {
+		return lower_bound(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline iterator upper_bound(const K& key) {
+		return upper_bound(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline std::pair<iterator, iterator> equal_range(const K& key) {
+		return equal_range(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline iterator find(const K& key) {
+		return find(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline const_iterator lower_bound(const K& key) const {
+		return lower_bound(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline const_iterator upper_bound(const K& key) const {
+		return upper_bound(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+		return equal_range(key, this->get_compare());
+	}
+	template<typename K, typename C = Compare, typename = typename C::is_transparent>
+	inline const_iterator find(const K& key) const {
+		return find(key, this->get_compare());
+	}
+
+	inline Compare key_comp() const {
+		return this->get_compare();
+	}
+	inline Compare value_comp() const {
+		return this->get_compare();
+	}
+
+	//replace the stored comparison and re-sort every object in one pass, handles stay valid
+	//with a KeyOf policy the keys must also preserve the new order
+	void resort(const Compare& comp) {
+		lock();
+		this->set_compare(comp);
+		std::vector<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>> sorted(objs.begin(), objs.end());
+		std::sort(sorted.begin(), sorted.end(),
+			[this](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a, const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& b) {
+				return a.less(b, this->get_compare());
+			});
+		objs.assign(sorted.begin(), sorted.end());
+		contents_changed();
+		unlock();
+	}
+
+private:
+	slot_internal::ordered_slot_map_object<T, Mut>* new_owned_object(const T& val) {
+		//allocate a new object, copy everything across, the map's count is the only one
+		ObjAlloc allctr;
+		slot_internal::ordered_slot_map_object<T, Mut>* nw = allctr.allocate(1);
+		new (nw) slot_internal::ordered_slot_map_object<T, Mut>();
+		nw->strongcount = 1;
+		nw->owned = true;
+		nw->moon.store(moon, std::memory_order_relaxed);
+		new (nw->obj) T(val);
+		return nw;
+	}
+	//objs must be empty, every object is owned by the map and no handles are made
+	//one sort of the pointer array and one assign into objs, O(n log n) instead of n sorted inserts
+	void assign_batch(std::vector<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>>& batch) {
+		//equal objects are ordered by node address, so even an already sorted copy is sorted again
+		std::sort(batch.begin(), batch.end(),
+			[this](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a, const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& b) {
+				return a.less(b, this->get_compare());
+			});
+		objs.assign(batch.begin(), batch.end());
+		contents_changed();
+	}
+	template<typename Itr>
+	void build_internal(Itr begin, Itr end) {
+		std::vector<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>> batch;
+		for(; begin != end; ++begin)
+			batch.push_back(slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>(new_owned_object(*begin)));
+		assign_batch(batch);
+	}
+
+	ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> insert_internal(const T& val, bool owner) {
 		//allocate a new object, copy everything across
 		ObjAlloc allctr;
 		slot_internal::ordered_slot_map_object<T, Mut>* nw = allctr.allocate(1);
@@ -1221,13 +1676,13 @@ private:
 		nw->moon = moon;
 		new (nw->obj) T(val);
 
-		ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> rtn;
+		ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> rtn;
 		rtn.ptr = nw;
 
 		insert(nw, owner);
 		return rtn;
 	}
-	ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> insert_internal(T&& val, bool owner) {
+	ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> insert_internal(T&& val, bool owner) {
 		//allocate a new object, copy everything across
 		ObjAlloc allctr;
 		slot_internal::ordered_slot_map_object<T, Mut>* nw = allctr.allocate(1);
@@ -1236,65 +1691,250 @@ private:
 		nw->moon = moon;
 		new (nw->obj) T(std::move(val));
 
-		ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> rtn;
+		ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> rtn;
 		rtn.ptr = nw;
 
 		insert(nw, owner);
 		return rtn;
 	}
 public:
-	ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> insert(const T& val, bool owner = false) {
+	ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> insert(const T& val, bool owner = false) {
 		lock();
-		ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> rtn = insert_internal(val, owner);
+		ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> rtn = insert_internal(val, owner);
 		unlock();
 		return rtn;
 	}
-	ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> insert(T&& val, bool owner = false) {
+	ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> insert(T&& val, bool owner = false) {
 		lock();
-		ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc> rtn = insert_internal(std::move(val), owner);
+		ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> rtn = insert_internal(std::move(val), owner);
 		unlock();
 		return rtn;
 	}
 	template<typename Itr>
-	std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>> insert(Itr begin, Itr end, bool owner = false) {
+	std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>> insert(Itr begin, Itr end, bool owner = false) {
 		lock();
-		std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>> rtn;
-		for(; begin != end; ++begin)
-			rtn.push_back(insert_internal(*begin, owner));
+		std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>> rtn;
+		std::vector<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>> batch;
+		for(; begin != end; ++begin) {
+			//allocate a new object, copy everything across
+			ObjAlloc allctr;
+			slot_internal::ordered_slot_map_object<T, Mut>* nw = allctr.allocate(1);
+			new (nw) slot_internal::ordered_slot_map_object<T, Mut>();
+			nw->strongcount = 1;
+			nw->moon = moon;
+			new (nw->obj) T(*begin);
+
+			rtn.emplace_back();
+			rtn.back().ptr = nw;
+			batch.push_back(slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>(nw));
+		}
+
+		if(batch.size() * 32 < objs.size()) {
+			//small batch, cheaper to insert one by one
+			for(auto it = batch.begin(); it != batch.end(); ++it)
+				insert(it->ptr, owner);
+			unlock();
+			return rtn;
+		}
+
+		//sort the batch and merge it with objs in one pass
+		auto entry_comp = [this](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a, const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& b) {
+			return a.less(b, this->get_compare());
+		};
+		std::sort(batch.begin(), batch.end(), entry_comp);
+		std::vector<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>> merged;
+		merged.reserve(objs.size() + batch.size());
+		std::merge(objs.begin(), objs.end(), batch.begin(), batch.end(), std::back_inserter(merged), entry_comp);
+		objs.assign(merged.begin(), merged.end());
+		contents_changed();
+
+		if(owner)
+			for(auto it = batch.begin(); it != batch.end(); ++it) {
+				it->ptr->owned = true;
+				++it->ptr->strongcount;
+			}
 		unlock();
 		return rtn;
 	}
 
-	inline bool is_valid(const slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) {
+	//replace the contents with [begin, end), like the range constructor the map owns every object
+	//handles to the old objects become invalid, the owned ones are released
+	template<typename Itr>
+	void assign(Itr begin, Itr end) {
+		lock();
+		clear_internal();
+		build_internal(begin, end);
+		unlock();
+	}
+
+	inline bool is_valid(const slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) {
+		//the moon of a live object never changes, no container lock
+		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_fast();
+		return obj != 0 && obj->moon.load(std::memory_order_acquire) == moon;
+	}
+	T* get_object(slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) {
+		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_fast();
+		if(obj == 0)
+			return 0;
+		return obj->moon.load(std::memory_order_acquire) == moon ? (T*)obj->obj : 0;
+	}
+	const T* get_object(const slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) {
+		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_fast();
+		if(obj == 0)
+			return 0;
+		return obj->moon.load(std::memory_order_acquire) == moon ? (const T*)obj->obj : 0;
+	}
+
+	//change an object through its handle, fn(T&) may change the sort key, the entry is then moved to its new position
+	//only the entries between the old and new position shift, the object itself never moves so handles stay valid
+	//returns false if the handle is invalid
+	template<typename Fn>
+	bool modify(slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl, Fn fn) {
 		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_nolock();
 		if(obj == 0)
 			return false;
 		lock();
-		bool rtn = obj->moon == moon;
+		if(obj->moon != moon) {
+			unlock();
+			return false;
+		}
+
+		//find the entry while the object is still in order
+		typedef typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator entry_iterator;
+		auto entry_comp = [this](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a, const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& b) {
+			return a.less(b, this->get_compare());
+		};
+		entry_iterator out;
+		if(!slot_internal::binary_search(objs, slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>(obj), entry_comp, out)) {
+			unlock();
+			return false;
+		}
+
+		fn(*(T*)obj->obj);
+		contents_changed();
+
+		//the key may have changed
+		slot_internal::ordered_slot_map_entry<T, Mut, KeyOf> ent(obj);
+		entry_iterator nxt = out;
+		++nxt;
+		if(out != objs.begin()) {
+			entry_iterator prv = out;
+			--prv;
+			if(entry_comp(ent, *prv)) {
+				entry_iterator pos = slot_internal::branchless_lower_bound(objs.begin(), prv, ent, entry_comp);
+				std::rotate(pos, out, nxt);
+				*pos = ent;
+				unlock();
+				return true;
+			}
+		}
+		if(nxt != objs.end() && entry_comp(*nxt, ent)) {
+			entry_iterator pos = slot_internal::branchless_lower_bound(nxt, objs.end(), ent, entry_comp);
+			std::rotate(out, nxt, pos);
+			*--pos = ent;
+			unlock();
+			return true;
+		}
+		*out = ent;
+		unlock();
+		return true;
+	}
+
+	//read only copy of the objects in sorted order for readers that don't need handles, copies of it share the values
+	//the first snapshot after a change copies the values once (O(n), no sort), the ones after it are O(1) until the next change
+	//this isn't copy on write, a single change costs the next snapshot a full copy, so it suits maps read far more than changed
+	//a held snapshot never changes. Writes through a handle's T& are not a change the map sees, use modify for those
+	typedef std::shared_ptr<const std::vector<T>> snapshot_type;
+	snapshot_type snapshot() {
+		lock();
+		snapshot_type rtn = snapshot_internal();
 		unlock();
 		return rtn;
 	}
-	T* get_object(slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) {
-		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_nolock();
-		if(obj == 0)
-			return 0;
+	inline snapshot_type snapshot() const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->snapshot();
+	}
+
+	//position of the first object not less than val (size() if there is none), nth(pos) gives the iterator
+	//searches an eytzinger ordered copy of the snapshot, for maps searched far more often than they change: the first search
+	//after a change builds it (O(n)), the ones after it touch fewer cache lines than lower_bound. Like snapshots it doesn't
+	//see writes through a handle's T&
+	size_t lower_bound_rank(const T& val) {
+		std::shared_ptr<const slot_internal::eytzinger_index<T>> idx = search_index();
+		return idx->lower_bound(val, this->get_compare());
+	}
+	inline size_t lower_bound_rank(const T& val) const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->lower_bound_rank(val);
+	}
+	//Less accepts (T, K) and orders the keys like Compare orders the objects
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	size_t lower_bound_rank(const K& key, Less comp) {
+		std::shared_ptr<const slot_internal::eytzinger_index<T>> idx = search_index();
+		return idx->lower_bound(key, comp);
+	}
+	template<typename K, typename Less, typename = typename Less::is_transparent>
+	inline size_t lower_bound_rank(const K& key, Less comp) const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->lower_bound_rank(key, comp);
+	}
+private:
+	//the read only copies no longer match the objects
+	inline void contents_changed() {
+		snap.reset();
+		search.reset();
+	}
+	snapshot_type snapshot_internal() {
+		if(!snap) {
+			std::shared_ptr<std::vector<T>> vals = std::make_shared<std::vector<T>>();
+			vals->reserve(objs.size());
+			for(auto it = objs.begin(); it != objs.end(); ++it)
+				vals->push_back(*(const T*)it->ptr->obj);
+			snap = std::move(vals);
+		}
+		return snap;
+	}
+	std::shared_ptr<const slot_internal::eytzinger_index<T>> search_index() {
 		lock();
-		T* rtn = (obj->moon == moon ? (T*)obj->obj : 0);
+		if(!search) {
+			snapshot_type vals = snapshot_internal();
+			search = std::make_shared<slot_internal::eytzinger_index<T>>(vals->begin(), vals->end());
+		}
+		std::shared_ptr<const slot_internal::eytzinger_index<T>> rtn = search;
 		unlock();
 		return rtn;
 	}
-	const T* get_object(const slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) {
+public:
+
+	//position of an object in the sorted order (0 is the smallest), size() if the handle is invalid or from another map
+	//the entry is found by binary search, O(log n) with either index
+	size_t rank(const slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) {
 		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_nolock();
-		if(obj == 0)
-			return 0;
 		lock();
-		const T* rtn = (obj->moon == moon ? (const T*)obj->obj : 0);
+		size_t rtn = objs.size();
+		typename Index::template rebind<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>, Alloc>::type::iterator out;
+		if(obj && obj->moon == moon &&
+		   slot_internal::binary_search(objs, slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>(obj),
+									   [this](const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& a,
+											  const slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>& b) {
+										   return a.less(b, this->get_compare());
+									   }, out))
+			rtn = out - objs.begin();
 		unlock();
 		return rtn;
 	}
+	//the object at position pos in the sorted order, end() if pos >= size()
+	//O(1) with slot_map_vector_index, O(log n) with slot_map_btree_index
+	iterator nth(size_t pos) {
+		lock();
+		iterator rtn(pos < objs.size() ? objs.begin() + pos : objs.end());
+		unlock();
+		return rtn;
+	}
+	inline const_iterator nth(size_t pos) const {
+		return const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->nth(pos);
+	}
 
 private:
-	void erase(slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl, bool strong) {
+	void erase(slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl, bool strong) {
 		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_nolock();
 		if(obj == 0)
 			return;
@@ -1302,119 +1942,147 @@ private:
 		if(obj->moon == moon) {
 			unlock();
 			if(strong)
-				((ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&)hdl).del();
+				((ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>&)hdl).del();
 			else
-				((ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&)hdl).del();
+				((ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>&)hdl).del();
 			return;
 		}
 		unlock();
 	}
-	bool owns_internal(const slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) const {
-		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_nolock();
-		if(obj == 0)
-			return false;
-		bool found = false;
-		if(obj->moon == moon) {
-			typename std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>, Alloc>::const_iterator out;
-			found = slot_internal::binary_search(store.begin(), store.end(), (const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&)hdl,
-						[](const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& a,
-						   const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& b) {
-							return a.ptr < b.ptr;
-						}, out);
-		}
-		return found;
-	}
 public:
-	void erase(ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) {
+	void erase(ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) {
 		erase(hdl, true);
 	}
-	void erase(ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) {
+	void erase(ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) {
 		erase(hdl, false);
 	}
 
-	bool owns(const slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) const {
+	bool owns(const slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) const {
 		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_nolock();
 		if(obj == 0)
 			return false;
 		//do we own this object?
-		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>*>(this)->lock();
-		bool found = false;
-		if(obj->moon == moon) {
-			typename std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>, Alloc>::const_iterator out;
-			found = slot_internal::binary_search(store.begin(), store.end(), (const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&)hdl,
-						[](const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& a,
-						   const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& b) {
-							return a.ptr < b.ptr;
-						}, out);
-		}
-		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc>*>(this)->unlock();
+		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->lock();
+		bool found = obj->moon == moon && obj->owned;
+		const_cast<ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>*>(this)->unlock();
 		return found;
 	}
-	bool release(slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) {
+	bool release(slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) {
 		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_nolock();
 		if(obj == 0)
 			return false;
-		//if we own this object then release it
+		//if we own this object then release it, the map's strong count moves to tmp
+		//tmp is dropped after the unlock, so the object may be destroyed without holding the map lock
+		ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare> tmp;
 		lock();
-		bool found = false;
-		if(obj->moon == moon) {
-			typename std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>, Alloc>::iterator out;
-			found = slot_internal::binary_search(store.begin(), store.end(), (ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&)hdl,
-						[](const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& a,
-						   const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& b) {
-							return a.ptr < b.ptr;
-						}, out);
-			if(found)
-				store.erase(out);
-			//TODO work out locking??? unlock incorrect here and above if(found) store.erase(out); as store.erase(out); may lock this again circular lock!!!
+		bool found = obj->moon == moon && obj->owned;
+		if(found) {
+			obj->owned = false;
+			tmp.ptr = obj;
 		}
 		unlock();
 		return found;
 	}
 private:
-	bool own(const slot_internal::internal_ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl, bool strong) {
-		//if we don't own this then don't take ownership
-		typename std::vector<ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>, Alloc>::iterator out;
-		bool found = slot_internal::binary_search(store.begin(), store.end(), (const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&)hdl,
-						[](const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& a,
-						   const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& b) {
-							return a.ptr < b.ptr;
-						}, out);
-		if(!found) {
-			if(strong)
-				store.insert(out, (const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&)hdl);
-			else
-				store.insert(out, (const ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>&)hdl);
+	bool own_internal(slot_internal::ordered_slot_map_object<T, Mut>* obj) {
+		//if we don't own this then take ownership, the map keeps a strong count
+		obj->mutex().lock();
+		if(!obj->owned) {
+			obj->owned = true;
+			++obj->strongcount;
 		}
+		obj->mutex().unlock();
 		return true;
 	}
 public:
-	bool own(const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) {
+	bool own(const ordered_slot_map_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) {
 		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_nolock();
 		if(obj == 0)
 			return false;
 		lock();
-		bool rslt = (obj->moon != moon ? false : own(hdl, true));
+		bool rslt = (obj->moon != moon ? false : own_internal(obj));
 		unlock();
 		return rslt;
 	}
-	bool own(const ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc>& hdl) {
+	bool own(const ordered_slot_map_weak_handle<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& hdl) {
 		slot_internal::ordered_slot_map_object<T, Mut>* obj = hdl.get_obj_nolock();
 		if(obj == 0)
 			return false;
 		lock();
-		bool rslt = (obj->moon != moon ? false : own(hdl, false));
+		bool rslt = (obj->moon != moon ? false : own_internal(obj));
 		unlock();
 		return rslt;
 	}
 
+	template<typename Pred>
+	size_t erase_if(Pred pred) {
+		lock();
+		//one sweep over objs, matching objects are destroyed like clear does and the rest compacted
+		size_t rtn = 0;
+		std::vector<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>> kept;
+		kept.reserve(objs.size());
+		for(auto it = objs.begin(); it != objs.end(); ++it) {
+			if(pred(*(const T*)it->ptr->obj)) {
+				destruct_internal(it->ptr);
+				drop_ownership(it->ptr);
+				++rtn;
+			} else
+				kept.push_back(*it);
+		}
+		objs.assign(kept.begin(), kept.end());
+		contents_changed();
+		unlock();
+		return rtn;
+	}
+
 	void clear() noexcept {
 		lock();
 		clear_internal();
 		unlock();
 	}
-	inline void defragment() noexcept {
-		//do nothing
+	//re-pack the objects only this map references (owned, no outside handles) so iterating them walks memory upwards
+	//handles point straight at the nodes, so nodes with outside handles stay where they are. The nodes this map alone
+	//references are interchangeable, their objects are moved so the lowest node address holds the first object in order
+	//with pool_allocator as ObjAlloc that turns a scan over them into a forward walk through the slabs
+	//not noexcept, it copies the entries and the movable objects and re-sorts the entries
+	void defragment() {
+		lock();
+		typedef slot_internal::ordered_slot_map_object<T, Mut> object_type;
+		//the movable nodes in iteration order, the map's strong count is the only reference to them
+		std::vector<object_type*> nodes;
+		std::vector<bool> movable;
+		movable.reserve(objs.size());
+		for(auto it = objs.begin(); it != objs.end(); ++it) {
+			movable.push_back(it->ptr->strongcount == 1 && it->ptr->weakcount == 0 && it->ptr->owned);
+			if(movable.back())
+				nodes.push_back(it->ptr);
+		}
+		if(nodes.size() < 2) {
+			unlock();
+			return;
+		}
+
+		std::vector<T> vals;
+		vals.reserve(nodes.size());
+		for(size_t i = 0; i < nodes.size(); ++i) {
+			vals.push_back(std::move(*(T*)nodes[i]->obj));
+			((T*)nodes[i]->obj)->~T();
+		}
+
+		//same set of nodes, only the entries of objs change node
+		std::sort(nodes.begin(), nodes.end());
+		for(size_t i = 0; i < nodes.size(); ++i)
+			new (nodes[i]->obj) T(std::move(vals[i]));
+		size_t i = 0;
+		size_t k = 0;
+		for(auto it = objs.begin(); it != objs.end() && k < nodes.size(); ++it, ++i)
+			if(movable[i])
+				it->ptr = nodes[k++];
+
+		//equal objects are ordered by node address, a moved object can now sit above a fixed one it is equal to
+		std::vector<slot_internal::ordered_slot_map_entry<T, Mut, KeyOf>> batch(objs.begin(), objs.end());
+		assign_batch(batch);
+		unlock();
 	}
 	~ordered_slot_map() {
 		lock();
@@ -1424,4 +2092,9 @@ public:
 	}
 };
 
+template<typename T, typename Mut, typename Alloc, typename ObjAlloc, typename MoonAlloc, typename KeyOf, typename Index, typename Compare, typename Pred>
+inline size_t erase_if(ordered_slot_map<T, Mut, Alloc, ObjAlloc, MoonAlloc, KeyOf, Index, Compare>& map, Pred pred) {
+	return map.erase_if(pred);
+}
+
 }
@@ -0,0 +1,153 @@
+/*----------------------------------------------------------------------------------*\
+ |																					|
+ | pool_allocator.hpp 																|
+ |																					|
+ | Author: (C) Copyright Richard Cookman 2019										|
+ |																					|
+ | Permission is hereby granted, free of charge, to any person obtaining a copy		|
+ | of this software and associated documentation files (the "Software"), to deal	|
+ | in the Software without restriction, including without limitation the rights		|
+ | to use, copy, modify, merge, publish, distribute, sublicense, and/or sell		|
+ | copies of the Software, and to permit persons to whom the Software is			|
+ | furnished to do so, subject to the following conditions:							|
+ |																					|
+ | The above copyright notice and this permission notice shall be included in all	|
+ | copies or substantial portions of the Software.									|
+ |																					|
+ | THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR		|
+ | IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,			|
+ | FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE		|
+ | AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER			|
+ | LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,	|
+ | OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE	|
+ | SOFTWARE.																		|
+ |																					|
+\*----------------------------------------------------------------------------------*/
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace std {
+
+namespace slot_internal {
+
+//per thread cache of free blocks for one pool, plain data so it never needs destructing
+struct pool_cache {
+	void* free = 0;									//singly linked list of released blocks
+	char* bump = 0;									//next unused block in the current slab
+	char* bumpend = 0;
+};
+
+}
+
+//slab/pool allocator for single object allocations, opt in as the ObjAlloc of ordered_slot_map
+//blocks are carved out of contiguous slabs of SlabObjects objects and recycled through a per thread free list, allocate(1)/deallocate(p, 1) are O(1) and lock free
+//a block goes onto the free list of the thread that releases it, so it suits maps whose objects are inserted and erased
+//on the same thread: a map filled on one thread and emptied on another keeps taking new slabs
+//slabs are kept for the life of the program, blocks released on a thread that then exits are not reused
+//allocations of more than one object go through the normal heap
+template<typename T, size_t SlabObjects = 256>
+struct pool_allocator {
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template<typename U>
+	struct rebind {
+		typedef pool_allocator<U, SlabObjects> other;
+	};
+
+	pool_allocator() = default;
+	template<typename U>
+	pool_allocator(const pool_allocator<U, SlabObjects>&) {}
+private:
+	union block {
+		block* next;
+		alignas(alignof(T)) char obj[sizeof(T)];
+	};
+	struct slab {
+		slab* next;
+		block blocks[SlabObjects];
+	};
+
+	static slot_internal::pool_cache& cache() {
+		static thread_local slot_internal::pool_cache chc;
+		return chc;
+	}
+	static std::atomic<slab*>& slabs() {
+		//every slab ever allocated, keeps them reachable
+		static std::atomic<slab*> slbs(0);
+		return slbs;
+	}
+	static void new_slab(slot_internal::pool_cache& chc) {
+		//operator new only aligns to max_align_t, over aligned objects get a padded allocation (never freed, like the slabs)
+		slab* slb;
+		if(alignof(slab) <= alignof(max_align_t))
+			slb = (slab*)::operator new(sizeof(slab));
+		else {
+			uintptr_t raw = (uintptr_t)::operator new(sizeof(slab) + alignof(slab) - 1);
+			slb = (slab*)((raw + alignof(slab) - 1) & ~(uintptr_t)(alignof(slab) - 1));
+		}
+		slb->next = slabs().load(std::memory_order_relaxed);
+		while(!slabs().compare_exchange_weak(slb->next, slb, std::memory_order_release, std::memory_order_relaxed));
+
+		chc.bump = (char*)&slb->blocks[0];
+		chc.bumpend = (char*)&slb->blocks[SlabObjects];
+	}
+public:
+	T* allocate(size_t n) {
+		if(n != 1) {
+			if(n > std::numeric_limits<size_t>::max() / sizeof(T))
+				throw std::bad_alloc();
+			return (T*)::operator new(n * sizeof(T));
+		}
+
+		slot_internal::pool_cache& chc = cache();
+		if(chc.free) {
+			block* blk = (block*)chc.free;
+			chc.free = blk->next;
+			return (T*)blk->obj;
+		}
+		if(chc.bump == chc.bumpend)
+			new_slab(chc);
+		block* blk = (block*)chc.bump;
+		chc.bump += sizeof(block);
+		return (T*)blk->obj;
+	}
+	void deallocate(T* ptr, size_t n) {
+		if(ptr == 0)
+			return;
+		if(n != 1) {
+			::operator delete(ptr);
+			return;
+		}
+
+		slot_internal::pool_cache& chc = cache();
+		block* blk = (block*)ptr;
+		blk->next = (block*)chc.free;
+		chc.free = blk;
+	}
+
+	inline size_t max_size() const noexcept {
+		return std::numeric_limits<size_t>::max() / sizeof(T);
+	}
+};
+
+template<typename T, typename U, size_t SlabObjects>
+inline bool operator==(const pool_allocator<T, SlabObjects>&, const pool_allocator<U, SlabObjects>&) {
+	return true;
+}
+template<typename T, typename U, size_t SlabObjects>
+inline bool operator!=(const pool_allocator<T, SlabObjects>&, const pool_allocator<U, SlabObjects>&) {
+	return false;
+}
+
+}
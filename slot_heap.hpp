@@ -0,0 +1,718 @@
+/*----------------------------------------------------------------------------------*\
+ |																					|
+ | slot_heap.hpp 																	|
+ |																					|
+ | Author: (C) Copyright Richard Cookman 2019										|
+ |																					|
+ | Permission is hereby granted, free of charge, to any person obtaining a copy		|
+ | of this software and associated documentation files (the "Software"), to deal	|
+ | in the Software without restriction, including without limitation the rights		|
+ | to use, copy, modify, merge, publish, distribute, sublicense, and/or sell		|
+ | copies of the Software, and to permit persons to whom the Software is			|
+ | furnished to do so, subject to the following conditions:							|
+ |																					|
+ | The above copyright notice and this permission notice shall be included in all	|
+ | copies or substantial portions of the Software.									|
+ |																					|
+ | THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR		|
+ | IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,			|
+ | FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE		|
+ | AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER			|
+ | LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,	|
+ | OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE	|
+ | SOFTWARE.																		|
+ |																					|
+\*----------------------------------------------------------------------------------*/
+#pragma once
+
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "slot_map_algorithm.hpp"
+#include "slot_map_moon.hpp"
+#include "empty_mutex.hpp"
+#include "generation_data.hpp"
+
+//also includes the handle base shared with basic_ordered_slot_map
+#include "basic_ordered_slot_map.hpp"
+
+namespace std {
+
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Compare, size_t Arity>
+struct slot_heap;
+
+namespace slot_internal {
+
+template<typename T>
+struct slot_heap_slot {
+	size_t backidx;
+	T obj;
+};
+
+}
+
+//strong and weak handles work like the basic_ordered_slot_map ones, objects are read only through them
+//as changing an object in place would break the heap order, use slot_heap::modify instead
+template<typename T,
+		 typename Mut = slot_internal::empty_mutex,
+		 typename Alloc = std::allocator<T>,
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>,
+		 size_t Arity = 4>
+struct slot_heap_handle : slot_internal::internal_basic_ordered_slot_map_handle<Mut> {
+	slot_heap_handle() = default;
+
+	friend struct slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>;
+
+	slot_heap_handle(const slot_heap_handle& rhs) {
+		*this = (const slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+	}
+	slot_heap_handle(slot_heap_handle&& rhs) {
+		*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+		rhs.clear();
+	}
+
+	slot_heap_handle(const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& rhs) {
+		if(rhs.moon && slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), false))
+			*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+	}
+
+	inline slot_heap_handle& operator=(const slot_heap_handle& rhs) {
+		const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& tmp = rhs;
+		return *this = tmp;
+	}
+	inline slot_heap_handle& operator=(slot_heap_handle&& rhs) {
+		if(this == &rhs)
+			return *this;
+
+		this->~slot_heap_handle();
+
+		*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+
+		rhs.clear();
+		return *this;
+	}
+
+	slot_heap_handle& operator=(const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& rhs) {
+		if(this == &rhs)
+			return *this;
+
+		this->~slot_heap_handle();
+
+		if(rhs.moon && slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), false))
+			*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+		return *this;
+	}
+
+	~slot_heap_handle() {
+		if(this->moon)
+			slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::decrement_handle_external(*this, false);
+		this->clear();
+	}
+
+	inline const T& operator*() const {
+		return *slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::get_object_external(const_cast<slot_heap_handle&>(*this), false);
+	}
+	inline const T* operator->() const {
+		return slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::get_object_external(const_cast<slot_heap_handle&>(*this), false);
+	}
+	inline operator const T*() const {
+		return slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::get_object_external(const_cast<slot_heap_handle&>(*this), false);
+	}
+};
+
+template<typename T,
+		 typename Mut = slot_internal::empty_mutex,
+		 typename Alloc = std::allocator<T>,
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>,
+		 size_t Arity = 4>
+struct slot_heap_weak_handle : slot_internal::internal_basic_ordered_slot_map_handle<Mut> {
+	slot_heap_weak_handle() = default;
+
+	friend struct slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>;
+
+	slot_heap_weak_handle(const slot_heap_weak_handle& rhs) {
+		*this = (const slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+	}
+	slot_heap_weak_handle(slot_heap_weak_handle&& rhs) {
+		*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+		rhs.clear();
+	}
+
+	slot_heap_weak_handle(const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& rhs) {
+		if(rhs.moon && slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), true))
+			*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+	}
+
+	inline slot_heap_weak_handle& operator=(const slot_heap_weak_handle& rhs) {
+		const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& tmp = rhs;
+		return *this = tmp;
+	}
+	inline slot_heap_weak_handle& operator=(slot_heap_weak_handle&& rhs) {
+		if(this == &rhs)
+			return *this;
+
+		this->~slot_heap_weak_handle();
+
+		*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+
+		rhs.clear();
+		return *this;
+	}
+
+	slot_heap_weak_handle& operator=(const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& rhs) {
+		if(this == &rhs)
+			return *this;
+
+		this->~slot_heap_weak_handle();
+
+		if(rhs.moon && slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::increment_handle_external(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(rhs), true))
+			*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)this = (slot_internal::internal_basic_ordered_slot_map_handle<Mut>&)rhs;
+		return *this;
+	}
+
+	~slot_heap_weak_handle() {
+		if(this->moon)
+			slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::decrement_handle_external(*this, true);
+		this->clear();
+	}
+
+	inline const T& operator*() const {
+		return *slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::get_object_external(const_cast<slot_heap_weak_handle&>(*this), true);
+	}
+	inline const T* operator->() const {
+		return slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::get_object_external(const_cast<slot_heap_weak_handle&>(*this), true);
+	}
+	inline operator const T*() const {
+		return slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>::get_object_external(const_cast<slot_heap_weak_handle&>(*this), true);
+	}
+};
+
+//indexed d-ary min-heap, top() is the smallest object under Compare (std::priority_queue keeps the largest)
+//every object has a handle (same generation machinery as basic_ordered_slot_map), the heap keeps a back index from each
+//handle slot to the object's position so erase/modify through a handle are O(log n), push/pop are O(log n) and top is O(1)
+//Arity children per node, 4 keeps a node's children in one cache line for small T and halves the depth of a binary heap
+template<typename T,
+		 typename Mut = slot_internal::empty_mutex,
+		 typename Alloc = std::allocator<T>,
+		 typename MoonAlloc = std::allocator<slot_internal::slot_map_moon<Mut>>,
+		 typename Compare = std::less<T>,
+		 size_t Arity = 4>
+struct slot_heap : private slot_internal::compare_holder<Compare> {
+	static_assert(Arity >= 2, "slot_heap needs at least two children per node");
+private:
+	struct slot_index {
+		slot_internal::generation_data<uint32_t> gens;
+		size_t next;									//used when object doesn't exist to reference the next object to allocate
+		size_t pos;										//position of the object in items
+	};
+
+	typedef typename slot_internal::slot_map_moon<Mut> MoonType;
+
+	MoonType* moon = 0;
+	slot_index* firstslot = 0;
+	slot_index* lastslot = 0;
+	std::vector<slot_internal::slot_heap_slot<T>, Alloc> items;
+	std::vector<slot_index, Alloc> indexes;
+
+	friend struct slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>;
+	friend struct slot_heap_weak_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>;
+
+	void extend(size_t extnd) {
+		if(extnd == 0)
+			return;
+
+		//the free list may not be empty (reserve), keep it as offsets while indexes moves
+		size_t csze = indexes.size();
+		size_t nxt = 0;
+		size_t lst = 0;
+		if(firstslot) {
+			nxt = std::distance(&indexes[0], firstslot);
+			lst = std::distance(&indexes[0], lastslot);
+		}
+		indexes.resize(csze + extnd);
+
+		//append all of the new indexes onto the front of the slot list
+		memset((void*)&indexes[csze], 0, sizeof(slot_index) * extnd);
+		for(size_t i = csze; i < csze + extnd; ++i)
+			if(i == csze + extnd - 1)
+				indexes[i].next = nxt;
+			else
+				indexes[i].next = i + 1;
+
+		bool wasempty = firstslot == 0;
+		firstslot = &indexes[csze];
+		if(wasempty)
+			lastslot = &indexes[csze + extnd - 1];
+		else
+			lastslot = &indexes[lst];
+	}
+	size_t get_next_free() {
+		if(items.size() == indexes.size())
+			//double the size
+			extend(indexes.size() ? indexes.size() : 16);
+
+		size_t pos = std::distance(&indexes[0], firstslot);
+
+		slot_index* nxt = &indexes[firstslot->next];
+		if(firstslot == lastslot)
+			nxt = 0;
+
+		if(nxt == 0) {
+			firstslot = 0;
+			lastslot = 0;
+		} else
+			firstslot = nxt;
+		return pos;
+	}
+	void free_index(slot_index* obj) {
+		obj->gens.set_invalid();
+		obj->pos = 0;
+
+		//add to the start of the free list
+		if(firstslot == 0) {
+			obj->next = 0;
+			firstslot = obj;
+			lastslot = obj;
+		} else {
+			obj->next = std::distance(&indexes[0], firstslot);
+			firstslot = obj;
+		}
+	}
+
+	void initMoon() {
+		MoonAlloc allctr;
+		moon = allctr.allocate(1);
+		new (moon) MoonType();
+		moon->slot_map_ptr = this;
+	}
+	void dtorMoon() {
+		if(moon) {
+			if(moon->count == 0) {
+				moon->~MoonType();
+				MoonAlloc allctr;
+				allctr.deallocate(moon, 1);
+			} else
+				moon->slot_map_ptr = 0;
+			moon = 0;
+		}
+	}
+
+	//the hole technique, the moving object is held aside and the others shift into the hole
+	void sift_up(size_t pos) {
+		const Compare& comp = this->get_compare();
+		slot_internal::slot_heap_slot<T> tmp(std::move(items[pos]));
+		while(pos > 0) {
+			size_t parent = (pos - 1) / Arity;
+			if(!comp(tmp.obj, items[parent].obj))
+				break;
+			items[pos] = std::move(items[parent]);
+			indexes[items[pos].backidx].pos = pos;
+			pos = parent;
+		}
+		items[pos] = std::move(tmp);
+		indexes[items[pos].backidx].pos = pos;
+	}
+	void sift_down(size_t pos) {
+		const Compare& comp = this->get_compare();
+		size_t sze = items.size();
+		slot_internal::slot_heap_slot<T> tmp(std::move(items[pos]));
+		for(;;) {
+			size_t first = pos * Arity + 1;
+			if(first >= sze)
+				break;
+			size_t last = first + Arity < sze ? first + Arity : sze;
+#if defined(__GNUC__)
+			//the children of the first child are the next level down
+			if(first * Arity + 1 < sze)
+				__builtin_prefetch(&items[first * Arity + 1]);
+#endif
+			//smallest child
+			size_t best = first;
+			for(size_t i = first + 1; i < last; ++i)
+				if(comp(items[i].obj, items[best].obj))
+					best = i;
+			if(!comp(items[best].obj, tmp.obj))
+				break;
+			items[pos] = std::move(items[best]);
+			indexes[items[pos].backidx].pos = pos;
+			pos = best;
+		}
+		items[pos] = std::move(tmp);
+		indexes[items[pos].backidx].pos = pos;
+	}
+	void restore(size_t pos) {
+		//the object at pos changed, move it up or down
+		if(pos > 0 && this->get_compare()(items[pos].obj, items[(pos - 1) / Arity].obj))
+			sift_up(pos);
+		else
+			sift_down(pos);
+	}
+	void remove_at(size_t pos) {
+		//move the last object into the hole and restore the order from there
+		size_t lst = items.size() - 1;
+		if(pos != lst) {
+			items[pos] = std::move(items[lst]);
+			indexes[items[pos].backidx].pos = pos;
+		}
+		items.pop_back();
+		if(pos < items.size())
+			restore(pos);
+	}
+	void destruct_object(slot_index* obj) {
+		size_t pos = obj->pos;
+		free_index(obj);
+		remove_at(pos);
+	}
+
+	slot_index* get_object_internal(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_index& rf = indexes[hdl.idx];
+		//test that the generation matches
+		if(!rf.gens.is_valid() || !rf.gens.match_generation(hdl.gen, weak)) {
+			//stale, the handle lets go of its generation and the moon
+			rf.gens.decrement_generation(hdl.gen, weak);
+			hdl.clear();
+			--moon->count;
+			return 0;
+		}
+		return &rf;
+	}
+	bool increment_handle(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_index* obj = get_object_internal(hdl, weak);
+		if(obj) {
+			slot_internal::generation_data<uint32_t>::counts& tmp = obj->gens.get_generation_count(hdl.gen);
+			if(weak)
+				++tmp.weakcount;
+			else
+				++tmp.strongcount;
+			return true;
+		}
+		return false;
+	}
+	void decrement_handle(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_index* obj = get_object_internal(hdl, weak);
+		if(obj) {
+			slot_internal::generation_data<uint32_t>::counts& tmp = obj->gens.get_generation_count(hdl.gen);
+			if(weak)
+				--tmp.weakcount;
+			else {
+				--tmp.strongcount;
+				if(tmp.strongcount == 0)
+					destruct_object(obj);
+			}
+			hdl.clear();
+			--moon->count;
+		}
+	}
+	template<typename V>
+	slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> push_internal(V&& val) {
+		size_t idx = get_next_free();
+		items.push_back(slot_internal::slot_heap_slot<T>{idx, std::forward<V>(val)});
+		sift_up(items.size() - 1);
+
+		slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> rtn;
+		rtn.moon = moon;
+		rtn.idx = idx;
+		rtn.gen = indexes[idx].gens.new_generation();
+		++moon->count;
+		return rtn;
+	}
+public:
+	slot_heap(size_t slots = 50) {
+		initMoon();
+		extend(slots);
+	}
+	explicit slot_heap(const Compare& comp, size_t slots = 50)
+		: slot_internal::compare_holder<Compare>(comp) {
+		initMoon();
+		extend(slots);
+	}
+	//handles reference one heap, a copy would have no handles to its objects
+	slot_heap(const slot_heap&) = delete;
+	slot_heap& operator=(const slot_heap&) = delete;
+	slot_heap(slot_heap&& rhs)
+		: slot_internal::compare_holder<Compare>(rhs.get_compare()) {
+		*this = std::move(rhs);
+	}
+	slot_heap& operator=(slot_heap&& rhs) {
+		if(this == &rhs)
+			return *this;
+		clear();
+		dtorMoon();
+
+		this->set_compare(rhs.get_compare());
+		moon = rhs.moon;
+		firstslot = rhs.firstslot;
+		lastslot = rhs.lastslot;
+		items = std::move(rhs.items);
+		indexes = std::move(rhs.indexes);
+		if(moon)
+			moon->slot_map_ptr = this;
+
+		//leave rhs empty but usable
+		rhs.moon = 0;
+		rhs.firstslot = 0;
+		rhs.lastslot = 0;
+		rhs.items.clear();
+		rhs.indexes.clear();
+		rhs.initMoon();
+		rhs.extend(10);
+		return *this;
+	}
+
+	void lock() {
+		moon->mut.lock();
+	}
+	void unlock() {
+		moon->mut.unlock();
+	}
+
+	typedef T value_type;
+	typedef Alloc allocator_type;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef T& reference;
+	typedef T const& const_reference;
+	typedef T* pointer;
+	typedef T const* const_pointer;
+	typedef Compare value_compare;
+	typedef slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> handle;
+	typedef slot_heap_weak_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> weak_handle;
+
+	// capacity:
+	inline size_type size() const noexcept {
+		const_cast<slot_heap*>(this)->lock();
+		size_type rtn = items.size();
+		const_cast<slot_heap*>(this)->unlock();
+		return rtn;
+	}
+	inline bool empty() const noexcept {
+		return size() == 0;
+	}
+	inline size_type max_size() const noexcept {
+		return std::numeric_limits<size_type>::max();
+	}
+	void reserve(size_type n) {
+		lock();
+		items.reserve(n);
+		if(n > indexes.size())
+			extend(n - indexes.size());
+		unlock();
+	}
+	inline Compare value_comp() const {
+		return this->get_compare();
+	}
+
+	// modifiers:
+	slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> push(const T& val) {
+		lock();
+		slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> rtn = push_internal(val);
+		unlock();
+		return rtn;
+	}
+	slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> push(T&& val) {
+		lock();
+		slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> rtn = push_internal(std::move(val));
+		unlock();
+		return rtn;
+	}
+
+	//smallest object, the heap must not be empty. like get_object the reference stays good until the heap is changed
+	inline const T& top() const {
+		const_cast<slot_heap*>(this)->lock();
+		const T& rtn = items[0].obj;
+		const_cast<slot_heap*>(this)->unlock();
+		return rtn;
+	}
+	//handle to the smallest object, the heap must not be empty
+	slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> top_handle() {
+		lock();
+		slot_internal::internal_basic_ordered_slot_map_handle<Mut> hdl;
+		hdl.moon = moon;
+		hdl.idx = items[0].backidx;
+		hdl.gen = indexes[hdl.idx].gens.increment_generation(false);
+		++moon->count;
+		slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity> rtn;
+		*(slot_internal::internal_basic_ordered_slot_map_handle<Mut>*)&rtn = hdl;
+		unlock();
+		return rtn;
+	}
+	//erase the smallest object, handles to it become invalid
+	void pop() {
+		lock();
+		if(!items.empty())
+			destruct_object(&indexes[items[0].backidx]);
+		unlock();
+	}
+
+private:
+	bool is_valid(const slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		return get_object_internal(const_cast<slot_internal::internal_basic_ordered_slot_map_handle<Mut>&>(hdl), weak) != 0;
+	}
+	const T* get_object(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_index* obj = get_object_internal(hdl, weak);
+		if(obj)
+			return &items[obj->pos].obj;
+		return 0;
+	}
+	void erase(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_index* obj = get_object_internal(hdl, weak);
+		if(obj)
+			destruct_object(obj);
+	}
+	template<typename Fn>
+	bool modify(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak, Fn& fn) {
+		slot_index* obj = get_object_internal(hdl, weak);
+		if(obj == 0)
+			return false;
+		fn(items[obj->pos].obj);
+		restore(obj->pos);
+		return true;
+	}
+public:
+	inline bool is_valid(const slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>& hdl) {
+		if(hdl.moon != moon)
+			return false;
+		lock();
+		bool rtn = is_valid(hdl, false);
+		unlock();
+		return rtn;
+	}
+	inline bool is_valid(const slot_heap_weak_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>& hdl) {
+		if(hdl.moon != moon)
+			return false;
+		lock();
+		bool rtn = is_valid(hdl, true);
+		unlock();
+		return rtn;
+	}
+	inline const T* get_object(const slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>& hdl) {
+		if(hdl.moon != moon)
+			return 0;
+		lock();
+		const T* rtn = get_object(const_cast<slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>&>(hdl), false);
+		unlock();
+		return rtn;
+	}
+	inline const T* get_object(const slot_heap_weak_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>& hdl) {
+		if(hdl.moon != moon)
+			return 0;
+		lock();
+		const T* rtn = get_object(const_cast<slot_heap_weak_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>&>(hdl), true);
+		unlock();
+		return rtn;
+	}
+	inline void erase(slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>& hdl) {
+		if(hdl.moon != moon)
+			return;
+		lock();
+		erase(hdl, false);
+		unlock();
+	}
+	inline void erase(slot_heap_weak_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>& hdl) {
+		if(hdl.moon != moon)
+			return;
+		lock();
+		erase(hdl, true);
+		unlock();
+	}
+
+	//change an object through its handle (decrease or increase key), fn(T&) is applied and the object sifted up or down
+	//returns false if the handle is invalid
+	template<typename Fn>
+	inline bool modify(slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>& hdl, Fn fn) {
+		if(hdl.moon != moon)
+			return false;
+		lock();
+		bool rtn = modify(hdl, false, fn);
+		unlock();
+		return rtn;
+	}
+	template<typename Fn>
+	inline bool modify(slot_heap_weak_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>& hdl, Fn fn) {
+		if(hdl.moon != moon)
+			return false;
+		lock();
+		bool rtn = modify(hdl, true, fn);
+		unlock();
+		return rtn;
+	}
+	template<typename V>
+	inline bool update(slot_heap_handle<T, Mut, Alloc, MoonAlloc, Compare, Arity>& hdl, V&& val) {
+		return modify(hdl, [&val](T& obj) { obj = std::forward<V>(val); });
+	}
+
+	void clear() noexcept {
+		if(moon == 0)
+			return;
+		lock();
+		//every object goes, outstanding handles become invalid
+		for(auto it = items.begin(); it != items.end(); ++it)
+			free_index(&indexes[it->backidx]);
+		items.clear();
+		unlock();
+	}
+
+private:
+	static slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>* getMap(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl) {
+		//get the heap and lock this
+		if(hdl.moon == 0)
+			return 0;
+		//does this still point to a valid slot_heap?
+		hdl.moon->mut.lock();
+		if(hdl.moon->slot_map_ptr == 0) {
+			--hdl.moon->count;
+			if(hdl.moon->count == 0) {
+				hdl.moon->mut.unlock();
+				//heap already gone, remove the lingering moon
+				hdl.moon->~MoonType();
+				MoonAlloc allctr;
+				allctr.deallocate(hdl.moon, 1);
+				hdl.clear();
+				return 0;
+			}
+			hdl.moon->mut.unlock();
+			hdl.clear();
+			return 0;
+		}
+		return (slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>*)hdl.moon->slot_map_ptr;
+	}
+	static bool increment_handle_external(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>* map = getMap(hdl);
+		if(map == 0)
+			return false;
+		bool rtn = map->increment_handle(hdl, weak);
+		if(rtn)
+			++map->moon->count;
+		map->unlock();
+		return rtn;
+	}
+	static void decrement_handle_external(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>* map = getMap(hdl);
+		if(map == 0)
+			return;
+		map->decrement_handle(hdl, weak);
+		map->unlock();
+	}
+	static const T* get_object_external(slot_internal::internal_basic_ordered_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_heap<T, Mut, Alloc, MoonAlloc, Compare, Arity>* map = getMap(hdl);
+		if(map == 0)
+			return 0;
+		const T* rtn = map->get_object(hdl, weak);
+		map->unlock();
+		return rtn;
+	}
+
+public:
+	~slot_heap() {
+		clear();
+		dtorMoon();
+	}
+};
+
+}
@@ -25,8 +25,11 @@
 \*----------------------------------------------------------------------------------*/
 #pragma once
 
+#include <algorithm>
 #include <limits>
+#include <type_traits>
 #include <vector>
+#include <stdint.h>
 #include <string.h>
 
 #include "slot_map_moon.hpp"
@@ -40,6 +43,8 @@ struct slot_map;
 
 namespace slot_internal {
 
+struct slot_map_serializer;
+
 template<typename T>
 struct slot {
 	slot_internal::generation_data<uint32_t> gens;
@@ -89,10 +94,13 @@ public:
 	typedef T const* const_pointer;
 
 	slot_map_iterator() = default;
+	//write access, the object is marked as changed
 	inline T& operator*() {
+		map->set_dirty(std::distance(map->items.begin(), itr));
 		return *(T*)itr->unn.obj;
 	}
 	inline T* operator->() {
+		map->set_dirty(std::distance(map->items.begin(), itr));
 		return (T*)itr->unn.obj;
 	}
 	slot_map_iterator& operator++() {
@@ -269,10 +277,13 @@ public:
 	typedef T const* const_pointer;
 
 	slot_map_reverse_iterator() = default;
+	//write access, the object is marked as changed
 	inline T& operator*() {
+		map->set_dirty(std::distance(itr, map->items.rend()) - 1);
 		return *(T*)itr->unn.obj;
 	}
 	inline T* operator->() {
+		map->set_dirty(std::distance(itr, map->items.rend()) - 1);
 		return (T*)itr->unn.obj;
 	}
 	slot_map_reverse_iterator& operator++() {
@@ -451,12 +462,12 @@ struct slot_map_handle : slot_internal::internal_slot_map_handle<Mut> {
 
 	friend struct slot_map<T, Mut, Alloc, MoonAlloc>;
 
-	slot_map_handle(const slot_map_handle& rhs) {
-		new (this) slot_internal::internal_slot_map_handle<Mut>((const slot_internal::internal_slot_map_handle<Mut>&)rhs);
-	}
-	slot_map_handle(slot_map_handle&& rhs) {
-		new (this) slot_internal::internal_slot_map_handle<Mut>(std::move((slot_internal::internal_slot_map_handle<Mut>&)rhs));
-	}
+	slot_map_handle(const slot_map_handle& rhs)
+		: slot_map_handle((const slot_internal::internal_slot_map_handle<Mut>&)rhs)
+	{}
+	slot_map_handle(slot_map_handle&& rhs)
+		: slot_map_handle(std::move((slot_internal::internal_slot_map_handle<Mut>&)rhs))
+	{}
 
 	slot_map_handle(const slot_internal::internal_slot_map_handle<Mut>& rhs) {
 		if(rhs.moon && slot_map<T, Mut, Alloc, MoonAlloc>::increment_handle_external(const_cast<slot_internal::internal_slot_map_handle<Mut>&>(rhs), false))
@@ -464,6 +475,7 @@ struct slot_map_handle : slot_internal::internal_slot_map_handle<Mut> {
 	}
 	slot_map_handle(slot_internal::internal_slot_map_handle<Mut>&& rhs) {
 		*(slot_internal::internal_slot_map_handle<Mut>*)this = (slot_internal::internal_slot_map_handle<Mut>&)rhs;
+		rhs.clear();
 	}
 
 	inline slot_map_handle& operator=(const slot_map_handle& rhs) {
@@ -503,6 +515,7 @@ struct slot_map_handle : slot_internal::internal_slot_map_handle<Mut> {
 		this->clear();
 	}
 
+	//write access, the slot is marked as changed for the next write_delta
 	inline T& operator*() {
 		return *slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, false);
 	}
@@ -510,18 +523,19 @@ struct slot_map_handle : slot_internal::internal_slot_map_handle<Mut> {
 		return slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, false);
 	}
 
+	//reads, the slot isn't marked as changed
 	inline const T& operator*() const {
-		return const_cast<const T&>(*slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(const_cast<slot_internal::internal_slot_map_handle<Mut>&>(*this), false));
+		return *slot_map<T, Mut, Alloc, MoonAlloc>::get_const_object_external(*this, false);
 	}
 	inline const T* operator->() const {
-		return const_cast<const T*>(slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(const_cast<slot_internal::internal_slot_map_handle<Mut>&>(*this), false));
+		return slot_map<T, Mut, Alloc, MoonAlloc>::get_const_object_external(*this, false);
 	}
 
 	inline operator T*() {
 		return slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, false);
 	}
 	inline operator const T*() const {
-		return slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, false);
+		return slot_map<T, Mut, Alloc, MoonAlloc>::get_const_object_external(*this, false);
 	}
 };
 
@@ -534,12 +548,12 @@ struct slot_map_weak_handle : slot_internal::internal_slot_map_handle<Mut> {
 
 	friend struct slot_map<T, Mut, Alloc, MoonAlloc>;
 
-	slot_map_weak_handle(const slot_map_weak_handle& rhs) {
-		new (this) slot_internal::internal_slot_map_handle<Mut>((const slot_internal::internal_slot_map_handle<Mut>&)rhs);
-	}
-	slot_map_weak_handle(slot_map_weak_handle&& rhs) {
-		new (this) slot_internal::internal_slot_map_handle<Mut>(std::move((slot_internal::internal_slot_map_handle<Mut>&)rhs));
-	}
+	slot_map_weak_handle(const slot_map_weak_handle& rhs)
+		: slot_map_weak_handle((const slot_internal::internal_slot_map_handle<Mut>&)rhs)
+	{}
+	slot_map_weak_handle(slot_map_weak_handle&& rhs)
+		: slot_map_weak_handle(std::move((slot_internal::internal_slot_map_handle<Mut>&)rhs))
+	{}
 
 	slot_map_weak_handle(const slot_internal::internal_slot_map_handle<Mut>& rhs) {
 		if(rhs.moon && slot_map<T, Mut, Alloc, MoonAlloc>::increment_handle_external(const_cast<slot_internal::internal_slot_map_handle<Mut>&>(rhs), true))
@@ -547,6 +561,7 @@ struct slot_map_weak_handle : slot_internal::internal_slot_map_handle<Mut> {
 	}
 	slot_map_weak_handle(slot_internal::internal_slot_map_handle<Mut>&& rhs) {
 		*(slot_internal::internal_slot_map_handle<Mut>*)this = (slot_internal::internal_slot_map_handle<Mut>&)rhs;
+		rhs.clear();
 	}
 
 	inline slot_map_weak_handle& operator=(const slot_map_weak_handle& rhs) {
@@ -586,6 +601,7 @@ struct slot_map_weak_handle : slot_internal::internal_slot_map_handle<Mut> {
 		this->clear();
 	}
 
+	//write access, the slot is marked as changed for the next write_delta
 	inline T& operator*() {
 		return *slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, true);
 	}
@@ -593,18 +609,19 @@ struct slot_map_weak_handle : slot_internal::internal_slot_map_handle<Mut> {
 		return slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, true);
 	}
 
+	//reads, the slot isn't marked as changed
 	inline const T& operator*() const {
-		return const_cast<const T&>(*slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(const_cast<slot_internal::internal_slot_map_handle<Mut>&>(*this), true));
+		return *slot_map<T, Mut, Alloc, MoonAlloc>::get_const_object_external(*this, true);
 	}
 	inline const T* operator->() const {
-		return const_cast<const T*>(slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(const_cast<slot_internal::internal_slot_map_handle<Mut>&>(*this), true));
+		return slot_map<T, Mut, Alloc, MoonAlloc>::get_const_object_external(*this, true);
 	}
 
 	inline operator T*() {
 		return slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, true);
 	}
 	inline operator const T*() const {
-		return slot_map<T, Mut, Alloc, MoonAlloc>::get_object_external(*this, true);
+		return slot_map<T, Mut, Alloc, MoonAlloc>::get_const_object_external(*this, true);
 	}
 };
 
@@ -622,6 +639,7 @@ private:
 	slot_internal::slot<T>* firstslot = 0;
 	slot_internal::slot<T>* lastslot = 0;
 	std::vector<slot_internal::slot<T>, Alloc> items;
+	std::vector<uint64_t> dirty;						//a bit per slot, changed since the last checkpoint (save/write_delta)
 
 	friend struct slot_map_iterator<T, Mut, Alloc, MoonAlloc>;
 	friend struct slot_map_const_iterator<T, Mut, Alloc, MoonAlloc>;
@@ -631,12 +649,27 @@ private:
 	friend struct slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>;
 	friend struct slot_map_handle<T, Mut, Alloc, MoonAlloc>;
 
+	friend struct slot_internal::slot_map_serializer;
+
+	inline void set_dirty(size_t idx) {
+		dirty[idx / 64] |= (uint64_t)1 << (idx % 64);
+	}
+	void set_dirty(size_t first, size_t last) {
+		for(; first < last; ++first)
+			set_dirty(first);
+	}
+	inline void clear_dirty() {
+		std::fill(dirty.begin(), dirty.end(), 0);
+	}
+
 	void extend(size_t extnd) {
 		if(extnd == 0)
 			return;
 
 		size_t csze = items.size();
 		items.resize(csze + extnd);
+		dirty.resize((csze + extnd + 63) / 64, 0);
+		set_dirty(csze, csze + extnd);
 
 		size_t nxt = 0;
 		if(firstslot)
@@ -694,6 +727,7 @@ private:
 		firstslot = 0;
 		lastslot = 0;
 		items.clear();
+		dirty.clear();
 
 		if(!resetmoon)
 			extend(10);
@@ -728,6 +762,7 @@ public:
 		firstslot = std::move(rhs.firstslot);
 		lastslot = std::move(rhs.lastslot);
 		items = std::move(rhs.items);
+		dirty = std::move(rhs.dirty);
 
 		rhs.reset(true, true);
 		return *this;
@@ -735,11 +770,43 @@ public:
 
 	template<typename A>
 	slot_map clone(std::vector<slot_map_handle<T, Mut, Alloc, MoonAlloc>, A>& out) {
-		//go through all of the values in this, insert them into the rtn result
-		//return all of the handles to these values
-		slot_map rtn;
-		for(auto it = begin(); it != end(); ++it)
-			out.push_back(rtn.insert(*it));
+		//copy the slot array in one pass, every object keeps its slot and the free list is copied as it is
+		//only the generations start again, the handles of this map don't count in the clone
+		//return all of the handles to these values, in iteration order
+		lock();
+		slot_map rtn(0);
+		size_t sze = items.size();
+		rtn.items.resize(sze);
+		rtn.dirty.assign((sze + 63) / 64, 0);
+		rtn.set_dirty(0, sze);
+		out.reserve(out.size() + count);
+		if(sze > 0)
+			memset((void*)&rtn.items[0], 0, sizeof(slot_internal::slot<T>) * sze);
+		for(size_t i = 0; i < sze; ++i) {
+			slot_internal::slot<T>& src = items[i];
+			slot_internal::slot<T>& dst = rtn.items[i];
+			if(!src.gens.is_valid()) {
+				dst.unn.next = src.unn.next;
+				continue;
+			}
+			if(std::is_trivially_copyable<T>::value)
+				memcpy((void*)dst.unn.obj, (const void*)src.unn.obj, sizeof(T));
+			else
+				new (dst.unn.obj) T(*(const T*)src.unn.obj);
+
+			out.emplace_back();
+			slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl = out.back();
+			hdl.moon = rtn.moon;
+			hdl.idx = i;
+			hdl.gen = dst.gens.new_generation();
+		}
+		rtn.count = count;
+		rtn.moon->count += count;
+		if(firstslot) {
+			rtn.firstslot = &rtn.items[std::distance(&items[0], firstslot)];
+			rtn.lastslot = &rtn.items[std::distance(&items[0], lastslot)];
+		}
+		unlock();
 		return rtn;
 	}
 
@@ -768,6 +835,7 @@ public:
 private:
 	void destruct_object(slot_internal::slot<T>* obj) {
 		//remove object
+		set_dirty(std::distance(&items[0], obj));
 		obj->gens.set_invalid();
 		((T*)obj->unn.obj)->~T();
 
@@ -920,6 +988,7 @@ private:
 		} else
 			firstslot = nxt;
 		++count;
+		set_dirty(pos);
 		return pos;
 	}
 public:
@@ -978,8 +1047,11 @@ private:
 	}
 	T* get_object(slot_internal::internal_slot_map_handle<Mut>& hdl, bool weak) {
 		slot_internal::slot<T>* obj = get_object_internal(hdl, weak);
-		if(obj)
+		if(obj) {
+			//write access, the object may change
+			set_dirty(hdl.idx);
 			return (T*)obj->unn.obj;
+		}
 		return 0;
 	}
 	const T* get_object(const slot_internal::internal_slot_map_handle<Mut>& hdl, bool weak) {
@@ -994,6 +1066,15 @@ private:
 		if(obj)
 			destruct_object(obj);
 	}
+	template<typename Fn>
+	bool modify(slot_internal::internal_slot_map_handle<Mut>& hdl, bool weak, Fn& fn) {
+		slot_internal::slot<T>* obj = get_object_internal(hdl, weak);
+		if(obj == 0)
+			return false;
+		fn(*(T*)obj->unn.obj);
+		set_dirty(hdl.idx);
+		return true;
+	}
 public:
 
 	inline bool is_valid(const slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
@@ -1033,6 +1114,42 @@ public:
 		return rtn;
 	}
 
+	//change an object through its handle, fn(T&) is applied and the slot is marked as changed for the next write_delta
+	//returns false if the handle is invalid
+	template<typename Fn>
+	inline bool modify(slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl, Fn fn) {
+		lock();
+		bool rtn = modify(hdl, false, fn);
+		unlock();
+		return rtn;
+	}
+	template<typename Fn>
+	inline bool modify(slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>& hdl, Fn fn) {
+		lock();
+		bool rtn = modify(hdl, true, fn);
+		unlock();
+		return rtn;
+	}
+	//non-const access (handle dereference, get_object, iterators) marks the slot when the pointer is handed out, a write
+	//through a pointer kept from before the last checkpoint isn't seen until the slot is marked again
+	inline void mark_dirty(const slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+		lock();
+		if(is_valid(hdl, false))
+			set_dirty(hdl.idx);
+		unlock();
+	}
+	inline void mark_dirty(const slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+		lock();
+		if(is_valid(hdl, true))
+			set_dirty(hdl.idx);
+		unlock();
+	}
+	inline void mark_dirty(const slot_map_iterator<T, Mut, Alloc, MoonAlloc>& it) {
+		lock();
+		set_dirty(std::distance(items.begin(), it.itr));
+		unlock();
+	}
+
 	inline void erase(slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
 		lock();
 		erase(hdl, false);
@@ -1044,6 +1161,20 @@ public:
 		unlock();
 	}
 
+	template<typename Pred>
+	size_t erase_if(Pred pred) {
+		lock();
+		//one sweep, matching objects are destroyed and their slots go onto the free list
+		size_t rtn = 0;
+		for(auto it = items.begin(); it != items.end(); ++it)
+			if(it->gens.is_valid() && pred(*(const T*)it->unn.obj)) {
+				destruct_object(&*it);
+				++rtn;
+			}
+		unlock();
+		return rtn;
+	}
+
 	void clear() noexcept {
 		lock();
 		//just clear the data, erase everything
@@ -1066,6 +1197,7 @@ public:
 
 		firstslot = &items[0];
 		lastslot = &items[items.size() - 1];
+		set_dirty(0, items.size());
 		unlock();
 	}
 	void defragment() noexcept {
@@ -1090,6 +1222,8 @@ public:
 			}
 		if(set)
 			items[last].unn.next = 0;
+		//the free list links all changed
+		set_dirty(0, items.size());
 		unlock();
 	}
 private:
@@ -1138,9 +1272,16 @@ private:
 		slot_map<T, Mut, Alloc, MoonAlloc>* map = getMap(hdl);
 		if(map == 0)
 			return 0;
-		lock();
+		T* rtn = map->get_object(hdl, weak);
+		map->unlock();
+		return rtn;
+	}
+	static const T* get_const_object_external(const slot_internal::internal_slot_map_handle<Mut>& hdl, bool weak) {
+		slot_map<T, Mut, Alloc, MoonAlloc>* map = getMap(const_cast<slot_internal::internal_slot_map_handle<Mut>&>(hdl));
+		if(map == 0)
+			return 0;
 		const T* rtn = map->get_object(hdl, weak);
-		unlock();
+		map->unlock();
 		return rtn;
 	}
 
@@ -1159,4 +1300,9 @@ public:
 	}
 };
 
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Pred>
+inline size_t erase_if(slot_map<T, Mut, Alloc, MoonAlloc>& map, Pred pred) {
+	return map.erase_if(pred);
+}
+
 }
@@ -25,6 +25,12 @@
 \*----------------------------------------------------------------------------------*/
 #pragma once
 
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <stddef.h>
+
 namespace std {
 
 namespace slot_internal {
@@ -33,44 +39,169 @@ template<typename U>
 inline ptrdiff_t dist(U* first, U* last) {
 	return last - first;
 }
-inline int midpoint(unsigned imin, unsigned imax) {
-	return (imin + imax) >> 1;
+
+//prefetch the element off places after it, overload this for iterators that can't be advanced cheaply
+template<typename Itr>
+inline void prefetch(const Itr& it, size_t off) {
+#if defined(__GNUC__)
+	__builtin_prefetch(std::addressof(*(it + off)));
+#endif
+}
+
+//branchless lower bound, one comparison per step and no unpredictable branch
+//both of the possible next midpoints are prefetched while the current one is compared
+template<typename Itr, typename T, typename Less>
+Itr branchless_lower_bound(Itr beg, Itr end, const T& item, Less comp) {
+	size_t len = std::distance(beg, end);
+	if(len == 0)
+		return end;
+
+	while(len > 1) {
+		size_t half = len / 2;
+		size_t rest = len - half;
+		prefetch(beg, rest / 2);
+		prefetch(beg, half + rest / 2);
+		beg += comp(*(beg + (half - 1)), item) ? half : 0;
+		len = rest;
+	}
+	return comp(*beg, item) ? beg + 1 : beg;
+}
+
+//lower bound over a whole sorted sequence, overload this for sequences that can search faster than by iterator jumps
+template<typename Seq, typename T, typename Less>
+inline typename Seq::iterator sequence_lower_bound(Seq& seq, const T& item, Less comp) {
+	return branchless_lower_bound(seq.begin(), seq.end(), item, comp);
 }
+
+//holds the comparison of an ordered container, stateless comparisons are kept as an empty base and take no space
+template<typename Compare,
+#if __cplusplus >= 201402L
+		 bool Empty = std::is_empty<Compare>::value && !std::is_final<Compare>::value>
+#else
+		 bool Empty = std::is_empty<Compare>::value>
+#endif
+struct compare_holder : private Compare {
+	compare_holder() = default;
+	compare_holder(const Compare& cmp)
+		: Compare(cmp)
+	{}
+
+	inline const Compare& get_compare() const {
+		return *this;
+	}
+	inline void set_compare(const Compare&) {
+		//stateless, every instance orders the same
+	}
+};
+
+template<typename Compare>
+struct compare_holder<Compare, false> {
+	Compare compare = Compare();
+
+	compare_holder() = default;
+	compare_holder(const Compare& cmp)
+		: compare(cmp)
+	{}
+
+	inline const Compare& get_compare() const {
+		return compare;
+	}
+	inline void set_compare(const Compare& cmp) {
+		compare = cmp;
+	}
+};
+
 //basic binary search
 template<typename Itr, typename T, typename Less>
 bool binary_search(Itr beg, Itr end, const T& item,
 				   Less comp, Itr& out) {
 	//binary search return the insertion point, in both the found and not found case
-	int sze = std::distance(beg, end);
-	if(sze == 0) {
-		out = end;
-		return false;
+	out = slot_internal::branchless_lower_bound(beg, end, item, comp);
+	return out != end && !comp(item, *out);
+}
+template<typename Seq, typename T, typename Less>
+bool binary_search(Seq& seq, const T& item, Less comp, typename Seq::iterator& out) {
+	out = sequence_lower_bound(seq, item, comp);
+	return out != seq.end() && !comp(item, *out);
+}
+
+//read only search index holding a copy of a sorted sequence in eytzinger (bfs) order
+//the first levels of the tree share cache lines and the children of a node are prefetched before they are needed
+//build it from a container once it stops changing, lower_bound returns the position in the sorted sequence
+//ordered_slot_map::lower_bound_rank keeps one of these over its snapshot
+template<typename T,
+		 typename Alloc = std::allocator<T>>
+struct eytzinger_index {
+private:
+	std::vector<T, Alloc> vals;							//1 based, vals[0] unused
+	std::vector<size_t> ranks;							//position in the sorted sequence of each node
+
+	template<typename Itr>
+	void fill(Itr& it, size_t& rank, size_t k) {
+		if(k >= vals.size())
+			return;
+		fill(it, rank, 2 * k);
+		vals[k] = *it;
+		ranks[k] = rank++;
+		++it;
+		fill(it, rank, 2 * k + 1);
+	}
+public:
+	eytzinger_index() = default;
+	template<typename Itr>
+	eytzinger_index(Itr beg, Itr end) {
+		build(beg, end);
 	}
 
-	int imin = 0;
-	int imax = sze - 1;
-	int imid = 0;
-
-	// continue searching while [imin,imax] is not empty
-	while(imin <= imax) {
-		// calculate the midpoint for roughly equal partition
-		imid = midpoint(imin, imax);
-		// determine which subarray to search
-		if (comp(*(beg + imid), item))
-			// change min index to search upper subarray
-			imin = imid + 1;
-		else if(comp(item, *(beg + imid)))
-			// change max index to search lower subarray
-			imax = imid - 1;
-		else {
-			out = (beg + imid);
-			return true;
+	//beg, end must be sorted
+	template<typename Itr>
+	void build(Itr beg, Itr end) {
+		size_t sze = std::distance(beg, end);
+		vals.clear();
+		vals.resize(sze + 1);
+		ranks.assign(sze + 1, sze);
+		size_t rank = 0;
+		fill(beg, rank, 1);
+	}
+
+	inline size_t size() const {
+		return vals.size() ? vals.size() - 1 : 0;
+	}
+	inline void clear() {
+		vals.clear();
+		ranks.clear();
+	}
+
+	//position of the first element not less than item, size() if there is none
+	template<typename U, typename Less>
+	size_t lower_bound(const U& item, Less comp) const {
+		size_t sze = vals.size();
+		size_t k = 1;
+		while(k < sze) {
+#if defined(__GNUC__)
+			//the 16th descendants of k share a cache line for small T
+			if(16 * k < sze)
+				__builtin_prefetch(&vals[16 * k]);
+#endif
+			k = 2 * k + (comp(vals[k], item) ? 1 : 0);
 		}
+		//drop the right turns taken after the last left turn
+#if defined(__GNUC__)
+		k >>= __builtin_ctzll(~(unsigned long long)k) + 1;
+#else
+		while(k & 1)
+			k >>= 1;
+		k >>= 1;
+#endif
+		return k ? ranks[k] : size();
 	}
-	// item was not found return the insertion point
-	out = (beg + imin);
-	return false;
-}
+	template<typename U>
+	inline size_t lower_bound(const U& item) const {
+		return lower_bound(item, [](const T& lhs, const U& rhs) {
+			return lhs < rhs;
+		});
+	}
+};
 
 }
 
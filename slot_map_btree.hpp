@@ -0,0 +1,944 @@
+/*----------------------------------------------------------------------------------*\
+ |																					|
+ | slot_map_btree.hpp 																|
+ |																					|
+ | Author: (C) Copyright Richard Cookman 2019										|
+ |																					|
+ | Permission is hereby granted, free of charge, to any person obtaining a copy		|
+ | of this software and associated documentation files (the "Software"), to deal	|
+ | in the Software without restriction, including without limitation the rights		|
+ | to use, copy, modify, merge, publish, distribute, sublicense, and/or sell		|
+ | copies of the Software, and to permit persons to whom the Software is			|
+ | furnished to do so, subject to the following conditions:							|
+ |																					|
+ | The above copyright notice and this permission notice shall be included in all	|
+ | copies or substantial portions of the Software.									|
+ |																					|
+ | THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR		|
+ | IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,			|
+ | FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE		|
+ | AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER			|
+ | LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,	|
+ | OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE	|
+ | SOFTWARE.																		|
+ |																					|
+\*----------------------------------------------------------------------------------*/
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+
+namespace std {
+
+namespace slot_internal {
+
+template<typename Seq, bool Const>
+struct btree_sequence_iterator {
+	typedef typename Seq::value_type value_type;
+	typedef ptrdiff_t difference_type;
+	typedef typename std::conditional<Const, const value_type*, value_type*>::type pointer;
+	typedef typename std::conditional<Const, const value_type&, value_type&>::type reference;
+	typedef std::random_access_iterator_tag iterator_category;
+
+	const Seq* seq = 0;
+	typename Seq::leaf_node* lf = 0;				//0 for end()
+	size_t idx = 0;
+
+	btree_sequence_iterator() = default;
+	btree_sequence_iterator(const Seq* s, typename Seq::leaf_node* l, size_t i)
+		: seq(s), lf(l), idx(i)
+	{}
+	template<bool C>
+	btree_sequence_iterator(const btree_sequence_iterator<Seq, C>& rhs)
+		: seq(rhs.seq), lf(rhs.lf), idx(rhs.idx)
+	{}
+
+	inline size_t position() const {
+		return seq->position(lf, idx);
+	}
+
+	inline reference operator*() const {
+		return lf->values()[idx];
+	}
+	inline pointer operator->() const {
+		return &lf->values()[idx];
+	}
+	inline reference operator[](difference_type n) const {
+		return *(*this + n);
+	}
+	inline btree_sequence_iterator& operator++() {
+		//walk the leaf chain
+		if(++idx == lf->count) {
+			lf = lf->next;
+			idx = 0;
+		}
+		return *this;
+	}
+	inline btree_sequence_iterator operator++(int) {
+		btree_sequence_iterator it(*this);
+		++*this;
+		return it;
+	}
+	inline btree_sequence_iterator& operator--() {
+		if(lf == 0) {
+			lf = seq->tail;
+			idx = lf->count - 1;
+		} else if(idx == 0) {
+			lf = lf->prev;
+			idx = lf->count - 1;
+		} else
+			--idx;
+		return *this;
+	}
+	inline btree_sequence_iterator operator--(int) {
+		btree_sequence_iterator it(*this);
+		--*this;
+		return it;
+	}
+	btree_sequence_iterator& operator+=(difference_type n) {
+		//stay within the leaf if we can, otherwise go through the tree
+		if(lf && (difference_type)idx + n >= 0 && (difference_type)idx + n < (difference_type)lf->count) {
+			idx += n;
+			return *this;
+		}
+		*this = seq->iterator_at(position() + n);
+		return *this;
+	}
+	inline btree_sequence_iterator& operator-=(difference_type n) {
+		return *this += -n;
+	}
+	inline btree_sequence_iterator operator+(difference_type n) const {
+		btree_sequence_iterator it(*this);
+		return it += n;
+	}
+	inline btree_sequence_iterator operator-(difference_type n) const {
+		btree_sequence_iterator it(*this);
+		return it += -n;
+	}
+	template<bool C>
+	inline difference_type operator-(const btree_sequence_iterator<Seq, C>& rhs) const {
+		if(lf == rhs.lf)
+			return (difference_type)idx - (difference_type)rhs.idx;
+		return (difference_type)position() - (difference_type)rhs.position();
+	}
+
+	template<bool C>
+	inline bool operator==(const btree_sequence_iterator<Seq, C>& rhs) const {
+		return lf == rhs.lf && idx == rhs.idx;
+	}
+	template<bool C>
+	inline bool operator!=(const btree_sequence_iterator<Seq, C>& rhs) const {
+		return lf != rhs.lf || idx != rhs.idx;
+	}
+	template<bool C>
+	inline bool operator<(const btree_sequence_iterator<Seq, C>& rhs) const {
+		return (*this - rhs) < 0;
+	}
+	template<bool C>
+	inline bool operator>(const btree_sequence_iterator<Seq, C>& rhs) const {
+		return (*this - rhs) > 0;
+	}
+	template<bool C>
+	inline bool operator<=(const btree_sequence_iterator<Seq, C>& rhs) const {
+		return (*this - rhs) <= 0;
+	}
+	template<bool C>
+	inline bool operator>=(const btree_sequence_iterator<Seq, C>& rhs) const {
+		return (*this - rhs) >= 0;
+	}
+};
+
+//only prefetch within the current leaf, reaching other leaves means walking the tree
+template<typename Seq, bool Const>
+inline void prefetch(const btree_sequence_iterator<Seq, Const>& it, size_t off) {
+#if defined(__GNUC__)
+	if(it.lf && it.idx + off < it.lf->count)
+		__builtin_prefetch(&it.lf->values()[it.idx + off]);
+#endif
+}
+
+//counted b+tree holding a sequence of values, a drop in for the sorted vectors in the ordered containers
+//positional insert/erase are O(log n) instead of an O(n) move, values are kept in chained leaves so in order iteration stays linear
+//every inner node keeps the number of values under each child so positions can be found from the root, and the leftmost
+//leaf under each child so a search reads the child's first value without walking down to it
+//NodeBytes is the target size of each node, a few cache lines
+template<typename V,
+		 typename Alloc = std::allocator<V>,
+		 size_t NodeBytes = 256>
+struct btree_sequence {
+	struct inner_node;
+	struct node_base {
+		inner_node* parent;
+		size_t count;								//values in a leaf, children in an inner node
+		bool isleaf;
+	};
+
+	static constexpr size_t leaf_fit = (NodeBytes > sizeof(node_base) + 3 * sizeof(void*) ? (NodeBytes - sizeof(node_base) - 3 * sizeof(void*)) / sizeof(V) : 0);
+	static constexpr size_t leaf_capacity = (leaf_fit < 4 ? 4 : leaf_fit);
+	static constexpr size_t inner_fit = (NodeBytes > sizeof(node_base) ? (NodeBytes - sizeof(node_base)) / (2 * sizeof(void*) + sizeof(size_t)) : 0);
+	static constexpr size_t inner_capacity = (inner_fit < 4 ? 4 : inner_fit);
+	//below these a node is merged into a neighbour or takes some of its neighbour's values/children
+	static constexpr size_t leaf_min = leaf_capacity / 4;
+	static constexpr size_t inner_min = (inner_capacity / 4 < 2 ? 2 : inner_capacity / 4);
+
+	struct leaf_node : node_base {
+		leaf_node* prev;
+		leaf_node* next;
+		size_t first;								//values start here, free space at either end lets insert/erase move the shorter side
+		alignas(alignof(V)) char vals[sizeof(V) * leaf_capacity];
+
+		inline V* values() {
+			return (V*)vals + first;
+		}
+		//the storage without the offset, a value's slot here only changes when it is moved
+		inline V* slots() {
+			return (V*)vals;
+		}
+	};
+	struct inner_node : node_base {
+		size_t sizes[inner_capacity];				//number of values under each child
+		node_base* children[inner_capacity];
+		leaf_node* firsts[inner_capacity];			//leftmost leaf under each child, only changes when leaves are split or removed
+	};
+
+	typedef V value_type;
+	typedef Alloc allocator_type;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef V& reference;
+	typedef const V& const_reference;
+	typedef btree_sequence_iterator<btree_sequence, false> iterator;
+	typedef btree_sequence_iterator<btree_sequence, true> const_iterator;
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+	node_base* root = 0;
+	leaf_node* head = 0;
+	leaf_node* tail = 0;
+	size_t sze = 0;
+	leaf_node* moved_leaf = 0;						//leaf changed by the last insert/erase, 0 if the erase removed the leaf
+	size_t moved_first = 0;							//values()[moved_first, moved_last) of moved_leaf moved to a new slot
+	size_t moved_last = 0;							//(a split also moves every value of the new leaf)
+private:
+	typedef typename std::allocator_traits<Alloc>::template rebind_alloc<leaf_node> leaf_alloc;
+	typedef typename std::allocator_traits<Alloc>::template rebind_alloc<inner_node> inner_alloc;
+
+	leaf_node* new_leaf() {
+		leaf_alloc allctr;
+		leaf_node* nd = allctr.allocate(1);
+		nd->parent = 0;
+		nd->count = 0;
+		nd->isleaf = true;
+		nd->prev = 0;
+		nd->next = 0;
+		nd->first = 0;
+		return nd;
+	}
+	inner_node* new_inner() {
+		inner_alloc allctr;
+		inner_node* nd = allctr.allocate(1);
+		nd->parent = 0;
+		nd->count = 0;
+		nd->isleaf = false;
+		return nd;
+	}
+	void free_node(node_base* nd) {
+		if(nd->isleaf) {
+			leaf_alloc allctr;
+			allctr.deallocate((leaf_node*)nd, 1);
+		} else {
+			inner_alloc allctr;
+			allctr.deallocate((inner_node*)nd, 1);
+		}
+	}
+	void free_tree(node_base* nd) {
+		if(nd->isleaf) {
+			V* vals = ((leaf_node*)nd)->values();
+			for(size_t i = 0; i < nd->count; ++i)
+				vals[i].~V();
+		} else {
+			inner_node* in = (inner_node*)nd;
+			for(size_t i = 0; i < in->count; ++i)
+				free_tree(in->children[i]);
+		}
+		free_node(nd);
+	}
+
+	static size_t index_of(const inner_node* p, const node_base* nd) {
+		size_t i = 0;
+		for(; p->children[i] != nd; ++i);
+		return i;
+	}
+	static size_t node_size(const node_base* nd) {
+		if(nd->isleaf)
+			return nd->count;
+		const inner_node* in = (const inner_node*)nd;
+		size_t rtn = 0;
+		for(size_t i = 0; i < in->count; ++i)
+			rtn += in->sizes[i];
+		return rtn;
+	}
+	static leaf_node* first_leaf(node_base* nd) {
+		if(nd->isleaf)
+			return (leaf_node*)nd;
+		return ((inner_node*)nd)->firsts[0];
+	}
+	static void update_firsts(node_base* nd) {
+		//the leftmost leaf under nd changed, fix the parents it is the first child of
+		for(inner_node* p = nd->parent; p != 0; nd = p, p = p->parent) {
+			size_t i = index_of(p, nd);
+			p->firsts[i] = first_leaf(nd);
+			if(i != 0)
+				break;
+		}
+	}
+	static void add_size(node_base* nd, size_t n, bool add) {
+		//update the counts on the path to the root
+		for(inner_node* p = nd->parent; p != 0; nd = p, p = p->parent) {
+			size_t i = index_of(p, nd);
+			if(add)
+				p->sizes[i] += n;
+			else
+				p->sizes[i] -= n;
+		}
+	}
+
+	void insert_child(node_base* left, node_base* right, size_t rightsize) {
+		//right has been split off from left, rightsize of the values counted against left now belong to right
+		inner_node* p = left->parent;
+		if(p == 0) {
+			//grow a new root
+			p = new_inner();
+			p->children[0] = left;
+			p->sizes[0] = node_size(left);
+			p->firsts[0] = first_leaf(left);
+			p->children[1] = right;
+			p->sizes[1] = rightsize;
+			p->firsts[1] = first_leaf(right);
+			p->count = 2;
+			left->parent = p;
+			right->parent = p;
+			root = p;
+			return;
+		}
+		//make room first, the counts are still consistent here
+		if(p->count == inner_capacity) {
+			split_inner(p);
+			p = left->parent;
+		}
+		size_t i = index_of(p, left);
+		p->sizes[i] -= rightsize;
+		for(size_t k = p->count; k > i + 1; --k) {
+			p->children[k] = p->children[k - 1];
+			p->sizes[k] = p->sizes[k - 1];
+			p->firsts[k] = p->firsts[k - 1];
+		}
+		p->children[i + 1] = right;
+		p->sizes[i + 1] = rightsize;
+		p->firsts[i + 1] = first_leaf(right);
+		++p->count;
+		right->parent = p;
+	}
+	void split_inner(inner_node* p) {
+		inner_node* q = new_inner();
+		size_t h = p->count / 2;
+		size_t qsize = 0;
+		for(size_t i = h; i < p->count; ++i) {
+			q->children[i - h] = p->children[i];
+			q->sizes[i - h] = p->sizes[i];
+			q->firsts[i - h] = p->firsts[i];
+			q->children[i - h]->parent = q;
+			qsize += p->sizes[i];
+		}
+		q->count = p->count - h;
+		p->count = h;
+		insert_child(p, q, qsize);
+	}
+	leaf_node* split_leaf(leaf_node* lf) {
+		leaf_node* rt = new_leaf();
+		size_t h = lf->count / 2;
+		V* src = lf->values();
+		V* dst = rt->values();
+		for(size_t i = h; i < lf->count; ++i) {
+			new (dst + i - h) V(std::move(src[i]));
+			src[i].~V();
+		}
+		rt->count = lf->count - h;
+		lf->count = h;
+
+		//link into the leaf chain
+		rt->next = lf->next;
+		if(rt->next)
+			rt->next->prev = rt;
+		else
+			tail = rt;
+		rt->prev = lf;
+		lf->next = rt;
+
+		insert_child(lf, rt, rt->count);
+		return rt;
+	}
+	void remove_child(node_base* nd) {
+		//remove an empty node from its parent, removing any parents that become empty
+		inner_node* p = nd->parent;
+		free_node(nd);
+		if(p == 0) {
+			root = 0;
+			return;
+		}
+		size_t i = index_of(p, nd);
+		for(size_t k = i + 1; k < p->count; ++k) {
+			p->children[k - 1] = p->children[k];
+			p->sizes[k - 1] = p->sizes[k];
+			p->firsts[k - 1] = p->firsts[k];
+		}
+		--p->count;
+		if(p->count == 0)
+			remove_child(p);
+		else {
+			if(i == 0)
+				update_firsts(p);
+			rebalance_inner(p);
+			collapse_root();
+		}
+	}
+	void merge_inner(inner_node* lf, inner_node* rt) {
+		//move the children of rt onto the end of lf and remove rt, both share a parent
+		inner_node* p = lf->parent;
+		size_t i = index_of(p, lf);
+		for(size_t k = 0; k < rt->count; ++k) {
+			lf->children[lf->count + k] = rt->children[k];
+			lf->sizes[lf->count + k] = rt->sizes[k];
+			lf->firsts[lf->count + k] = rt->firsts[k];
+			rt->children[k]->parent = lf;
+		}
+		lf->count += rt->count;
+		p->sizes[i] += p->sizes[i + 1];
+		rt->count = 0;
+		remove_child(rt);
+	}
+	void borrow_inner(inner_node* nd, inner_node* sib) {
+		//move children from the fuller neighbour sib into nd until they hold about the same number
+		inner_node* p = nd->parent;
+		size_t i = index_of(p, nd);
+		size_t si = index_of(p, sib);
+		size_t n = (sib->count - nd->count) / 2;
+		size_t moved = 0;
+		if(si < i) {
+			//the last children of the previous node go in front
+			for(size_t k = nd->count; k > 0; --k) {
+				nd->children[k - 1 + n] = nd->children[k - 1];
+				nd->sizes[k - 1 + n] = nd->sizes[k - 1];
+				nd->firsts[k - 1 + n] = nd->firsts[k - 1];
+			}
+			for(size_t k = 0; k < n; ++k) {
+				size_t from = sib->count - n + k;
+				nd->children[k] = sib->children[from];
+				nd->sizes[k] = sib->sizes[from];
+				nd->firsts[k] = sib->firsts[from];
+				nd->children[k]->parent = nd;
+				moved += nd->sizes[k];
+			}
+			p->firsts[i] = nd->firsts[0];
+		} else {
+			//the first children of the next node go on the end
+			for(size_t k = 0; k < n; ++k) {
+				nd->children[nd->count + k] = sib->children[k];
+				nd->sizes[nd->count + k] = sib->sizes[k];
+				nd->firsts[nd->count + k] = sib->firsts[k];
+				sib->children[k]->parent = nd;
+				moved += sib->sizes[k];
+			}
+			for(size_t k = n; k < sib->count; ++k) {
+				sib->children[k - n] = sib->children[k];
+				sib->sizes[k - n] = sib->sizes[k];
+				sib->firsts[k - n] = sib->firsts[k];
+			}
+			p->firsts[si] = sib->firsts[0];
+		}
+		nd->count += n;
+		sib->count -= n;
+		p->sizes[i] += moved;
+		p->sizes[si] -= moved;
+	}
+	void rebalance_inner(inner_node* nd) {
+		//a small inner node is merged into a neighbour under the same parent, or takes children from the fuller one
+		inner_node* p = nd->parent;
+		if(p == 0 || nd->count >= inner_min)
+			return;
+		size_t i = index_of(p, nd);
+		inner_node* prv = i > 0 ? (inner_node*)p->children[i - 1] : 0;
+		inner_node* nxt = i + 1 < p->count ? (inner_node*)p->children[i + 1] : 0;
+		if(prv && prv->count + nd->count <= inner_capacity)
+			merge_inner(prv, nd);
+		else if(nxt && nd->count + nxt->count <= inner_capacity)
+			merge_inner(nd, nxt);
+		else if(prv || nxt)
+			borrow_inner(nd, prv && (!nxt || prv->count >= nxt->count) ? prv : nxt);
+	}
+	void collapse_root() {
+		//drop roots with a single child
+		while(root && !root->isleaf && root->count == 1) {
+			inner_node* old = (inner_node*)root;
+			root = old->children[0];
+			root->parent = 0;
+			free_node(old);
+		}
+	}
+	void unlink_leaf(leaf_node* lf) {
+		if(lf->prev)
+			lf->prev->next = lf->next;
+		else
+			head = lf->next;
+		if(lf->next)
+			lf->next->prev = lf->prev;
+		else
+			tail = lf->prev;
+	}
+	static void recentre(leaf_node* lf, size_t frst) {
+		//move the values of a leaf so they start at frst
+		V* src = lf->values();
+		V* dst = lf->slots() + frst;
+		if(dst < src)
+			for(size_t i = 0; i < lf->count; ++i) {
+				new (dst + i) V(std::move(src[i]));
+				src[i].~V();
+			}
+		else if(dst > src)
+			for(size_t i = lf->count; i > 0; --i) {
+				new (dst + i - 1) V(std::move(src[i - 1]));
+				src[i - 1].~V();
+			}
+		lf->first = frst;
+	}
+	void merge_leaf(leaf_node* lf, leaf_node* into) {
+		//move the few values of lf onto the near end of its neighbour into and remove lf, both share a parent
+		size_t n = lf->count;
+		V* src = lf->values();
+		if(into == lf->prev) {
+			moved_first = into->count;
+			if(into->first + into->count + n > leaf_capacity) {
+				recentre(into, 0);
+				moved_first = 0;
+			}
+			V* dst = into->values() + into->count;
+			for(size_t i = 0; i < n; ++i) {
+				new (dst + i) V(std::move(src[i]));
+				src[i].~V();
+			}
+			into->count += n;
+			moved_last = into->count;
+		} else {
+			moved_last = n;
+			if(into->first < n) {
+				recentre(into, leaf_capacity - into->count);
+				moved_last = into->count + n;
+			}
+			V* dst = into->values() - n;
+			for(size_t i = 0; i < n; ++i) {
+				new (dst + i) V(std::move(src[i]));
+				src[i].~V();
+			}
+			into->first -= n;
+			into->count += n;
+			moved_first = 0;
+		}
+		moved_leaf = into;
+		inner_node* p = lf->parent;
+		p->sizes[index_of(p, into)] += n;
+		lf->count = 0;
+		unlink_leaf(lf);
+		remove_child(lf);
+	}
+	void borrow_leaf(leaf_node* lf, leaf_node* sib) {
+		//move values from the fuller neighbour sib into lf until they hold about the same number, every value of lf is renumbered
+		size_t n = (sib->count - lf->count) / 2;
+		if(sib == lf->prev) {
+			if(lf->first < n)
+				recentre(lf, leaf_capacity - lf->count);
+			V* src = sib->values() + sib->count - n;
+			V* dst = lf->values() - n;
+			for(size_t i = 0; i < n; ++i) {
+				new (dst + i) V(std::move(src[i]));
+				src[i].~V();
+			}
+			lf->first -= n;
+		} else {
+			if(lf->first + lf->count + n > leaf_capacity)
+				recentre(lf, 0);
+			V* src = sib->values();
+			V* dst = lf->values() + lf->count;
+			for(size_t i = 0; i < n; ++i) {
+				new (dst + i) V(std::move(src[i]));
+				src[i].~V();
+			}
+			sib->first += n;
+		}
+		lf->count += n;
+		sib->count -= n;
+		inner_node* p = lf->parent;
+		p->sizes[index_of(p, lf)] += n;
+		p->sizes[index_of(p, sib)] -= n;
+		moved_leaf = lf;
+		moved_first = 0;
+		moved_last = lf->count;
+	}
+	void rebalance_leaf(leaf_node* lf) {
+		if(lf->count == 0) {
+			moved_leaf = 0;
+			unlink_leaf(lf);
+			remove_child(lf);
+			return;
+		}
+		//a small leaf is merged into a neighbour under the same parent, or takes values from the fuller one
+		//a merge only moves the values of the small leaf, removing it can underflow the inner nodes above
+		inner_node* p = lf->parent;
+		if(p == 0 || lf->count >= leaf_min)
+			return;
+		leaf_node* prv = lf->prev && lf->prev->parent == p ? lf->prev : 0;
+		leaf_node* nxt = lf->next && lf->next->parent == p ? lf->next : 0;
+		if(prv && prv->count + lf->count <= leaf_capacity)
+			merge_leaf(lf, prv);
+		else if(nxt && lf->count + nxt->count <= leaf_capacity)
+			merge_leaf(lf, nxt);
+		else if(prv || nxt)
+			borrow_leaf(lf, prv && (!nxt || prv->count >= nxt->count) ? prv : nxt);
+	}
+
+	template<typename U>
+	iterator insert_value(leaf_node* lf, size_t idx, U&& val) {
+		if(root == 0) {
+			lf = new_leaf();
+			root = lf;
+			head = lf;
+			tail = lf;
+			idx = 0;
+		} else if(lf == 0) {
+			//insert at end()
+			lf = tail;
+			idx = tail->count;
+		}
+		if(lf->count == leaf_capacity) {
+			leaf_node* rt = split_leaf(lf);
+			if(idx > lf->count) {
+				idx -= lf->count;
+				lf = rt;
+			}
+		}
+
+		//move the shorter side, values in front of idx move down or the ones after it move up
+		//when that side is full the free space is split between both ends first, so repeated inserts at one end stay amortised O(1)
+		bool front = idx < lf->count - idx;
+		bool all = front ? lf->first == 0 : lf->first + lf->count == leaf_capacity;
+		if(all)
+			recentre(lf, (leaf_capacity - lf->count + (front ? 1 : 0)) / 2);
+		moved_leaf = lf;
+		moved_first = all || front ? 0 : idx;
+		moved_last = all || !front ? lf->count + 1 : idx + 1;
+
+		V* vals = lf->values();
+		if(front) {
+			for(size_t i = 0; i < idx; ++i) {
+				new (vals + i - 1) V(std::move(vals[i]));
+				vals[i].~V();
+			}
+			--lf->first;
+			vals = lf->values();
+		} else
+			for(size_t i = lf->count; i > idx; --i) {
+				new (vals + i) V(std::move(vals[i - 1]));
+				vals[i - 1].~V();
+			}
+		new (vals + idx) V(std::forward<U>(val));
+		++lf->count;
+		++sze;
+		add_size(lf, 1, true);
+		return iterator(this, lf, idx);
+	}
+public:
+	btree_sequence() = default;
+	btree_sequence(const btree_sequence& rhs) {
+		*this = rhs;
+	}
+	btree_sequence(btree_sequence&& rhs) {
+		*this = std::move(rhs);
+	}
+	btree_sequence& operator=(const btree_sequence& rhs) {
+		if(this == &rhs)
+			return *this;
+		clear();
+		for(const_iterator it = rhs.begin(); it != rhs.end(); ++it)
+			push_back(*it);
+		return *this;
+	}
+	btree_sequence& operator=(btree_sequence&& rhs) {
+		if(this == &rhs)
+			return *this;
+		clear();
+		root = rhs.root;
+		head = rhs.head;
+		tail = rhs.tail;
+		sze = rhs.sze;
+		rhs.root = 0;
+		rhs.head = 0;
+		rhs.tail = 0;
+		rhs.sze = 0;
+		return *this;
+	}
+	~btree_sequence() {
+		clear();
+	}
+
+	size_t position(const leaf_node* lf, size_t idx) const {
+		//position of a value, found by summing the counts to the left of it on the way to the root
+		if(lf == 0)
+			return sze;
+		size_t pos = idx;
+		const node_base* nd = lf;
+		for(const inner_node* p = nd->parent; p != 0; nd = p, p = p->parent)
+			for(size_t i = 0; p->children[i] != nd; ++i)
+				pos += p->sizes[i];
+		return pos;
+	}
+	//search down from the root, at each level into the last child whose first value is less than item
+	//the first values are read through the leftmost leaf each inner node keeps per child
+	//iterator jumps would find each position from the leaves up
+	template<typename U, typename Less>
+	iterator lower_bound(const U& item, Less comp) const {
+		if(sze == 0)
+			return iterator(this, 0, 0);
+		const node_base* nd = root;
+		while(!nd->isleaf) {
+			const inner_node* in = (const inner_node*)nd;
+			size_t lo = 0;
+			size_t hi = in->count;
+			while(hi - lo > 1) {
+				size_t mid = lo + (hi - lo) / 2;
+				if(comp(in->firsts[mid]->values()[0], item))
+					lo = mid;
+				else
+					hi = mid;
+			}
+			nd = in->children[lo];
+		}
+		leaf_node* lf = (leaf_node*)nd;
+		V* vals = lf->values();
+		size_t idx = std::lower_bound(vals, vals + lf->count, item, comp) - vals;
+		//everything in this leaf is less, the next leaf starts at or after item
+		if(idx == lf->count)
+			return iterator(this, lf->next, 0);
+		return iterator(this, lf, idx);
+	}
+	iterator iterator_at(size_t pos) const {
+		if(pos >= sze)
+			return iterator(this, 0, 0);
+		const node_base* nd = root;
+		while(!nd->isleaf) {
+			const inner_node* in = (const inner_node*)nd;
+			size_t i = 0;
+			for(; pos >= in->sizes[i]; ++i)
+				pos -= in->sizes[i];
+			nd = in->children[i];
+		}
+		return iterator(this, (leaf_node*)nd, pos);
+	}
+
+	// iterators:
+	inline iterator begin() noexcept {
+		return iterator(this, head, 0);
+	}
+	inline const_iterator begin() const noexcept {
+		return const_iterator(this, head, 0);
+	}
+	inline iterator end() noexcept {
+		return iterator(this, 0, 0);
+	}
+	inline const_iterator end() const noexcept {
+		return const_iterator(this, 0, 0);
+	}
+	inline reverse_iterator rbegin() noexcept {
+		return reverse_iterator(end());
+	}
+	inline const_reverse_iterator rbegin() const noexcept {
+		return const_reverse_iterator(end());
+	}
+	inline reverse_iterator rend() noexcept {
+		return reverse_iterator(begin());
+	}
+	inline const_reverse_iterator rend() const noexcept {
+		return const_reverse_iterator(begin());
+	}
+	inline const_iterator cbegin() const noexcept {
+		return begin();
+	}
+	inline const_iterator cend() const noexcept {
+		return end();
+	}
+	inline const_reverse_iterator crbegin() const noexcept {
+		return rbegin();
+	}
+	inline const_reverse_iterator crend() const noexcept {
+		return rend();
+	}
+
+	// capacity:
+	inline size_type size() const noexcept {
+		return sze;
+	}
+	inline bool empty() const noexcept {
+		return sze == 0;
+	}
+	inline size_type capacity() const noexcept {
+		//nodes are allocated as needed
+		return sze;
+	}
+	inline void reserve(size_type) {}
+	inline void shrink_to_fit() {}
+
+	// access:
+	inline V& operator[](size_t pos) {
+		return *iterator_at(pos);
+	}
+	inline const V& operator[](size_t pos) const {
+		return *iterator_at(pos);
+	}
+	inline V& front() {
+		return head->values()[0];
+	}
+	inline V& back() {
+		return tail->values()[tail->count - 1];
+	}
+
+	// modifiers:
+	inline iterator insert(const_iterator pos, const V& val) {
+		return insert_value(pos.lf, pos.idx, val);
+	}
+	inline iterator insert(const_iterator pos, V&& val) {
+		return insert_value(pos.lf, pos.idx, std::move(val));
+	}
+	template<typename Itr>
+	void assign(Itr beg, Itr end) {
+		//build bottom up, values spread evenly over the leaves and children evenly over each level
+		clear();
+		size_t n = std::distance(beg, end);
+		if(n == 0)
+			return;
+
+		std::vector<node_base*> level;
+		size_t nleaves = (n + leaf_capacity - 1) / leaf_capacity;
+		leaf_node* prev = 0;
+		for(size_t l = 0; l < nleaves; ++l) {
+			size_t cnt = n / nleaves + (l < n % nleaves ? 1 : 0);
+			leaf_node* lf = new_leaf();
+			V* vals = lf->values();
+			for(size_t i = 0; i < cnt; ++i, ++beg)
+				new (vals + i) V(*beg);
+			lf->count = cnt;
+			lf->prev = prev;
+			if(prev)
+				prev->next = lf;
+			else
+				head = lf;
+			prev = lf;
+			level.push_back(lf);
+		}
+		tail = prev;
+		sze = n;
+
+		while(level.size() > 1) {
+			std::vector<node_base*> up;
+			size_t ngroups = (level.size() + inner_capacity - 1) / inner_capacity;
+			size_t at = 0;
+			for(size_t g = 0; g < ngroups; ++g) {
+				size_t cnt = level.size() / ngroups + (g < level.size() % ngroups ? 1 : 0);
+				inner_node* in = new_inner();
+				for(size_t i = 0; i < cnt; ++i, ++at) {
+					in->children[i] = level[at];
+					in->sizes[i] = node_size(level[at]);
+					in->firsts[i] = first_leaf(level[at]);
+					level[at]->parent = in;
+				}
+				in->count = cnt;
+				up.push_back(in);
+			}
+			level.swap(up);
+		}
+		root = level[0];
+	}
+	inline void push_back(const V& val) {
+		insert_value((leaf_node*)0, 0, val);
+	}
+	inline void push_back(V&& val) {
+		insert_value((leaf_node*)0, 0, std::move(val));
+	}
+	iterator erase(const_iterator pos) {
+		leaf_node* lf = pos.lf;
+		size_t idx = pos.idx;
+		size_t at = position(lf, idx);
+
+		//close the gap from the shorter side, erasing near either end of a leaf moves only the values up to that end
+		V* vals = lf->values();
+		vals[idx].~V();
+		if(idx < lf->count - 1 - idx) {
+			for(size_t i = idx; i > 0; --i) {
+				new (vals + i) V(std::move(vals[i - 1]));
+				vals[i - 1].~V();
+			}
+			++lf->first;
+			moved_first = 0;
+			moved_last = idx;
+		} else {
+			for(size_t i = idx + 1; i < lf->count; ++i) {
+				new (vals + i - 1) V(std::move(vals[i]));
+				vals[i].~V();
+			}
+			moved_first = idx;
+			moved_last = lf->count - 1;
+		}
+		moved_leaf = lf;
+		--lf->count;
+		--sze;
+		add_size(lf, 1, false);
+		rebalance_leaf(lf);
+		return iterator_at(at);
+	}
+	void clear() noexcept {
+		if(root)
+			free_tree(root);
+		root = 0;
+		head = 0;
+		tail = 0;
+		sze = 0;
+	}
+};
+
+template<typename V, typename Alloc, size_t NodeBytes, typename T, typename Less>
+inline typename btree_sequence<V, Alloc, NodeBytes>::iterator sequence_lower_bound(btree_sequence<V, Alloc, NodeBytes>& seq, const T& item, Less comp) {
+	return seq.lower_bound(item, comp);
+}
+
+}
+
+//selects the container used for the sorted lists of the ordered containers
+//slot_map_vector_index is a flat sorted vector, fastest to search and iterate but insert/erase move O(n) values
+struct slot_map_vector_index {
+	template<typename V, typename Alloc>
+	struct rebind {
+		typedef std::vector<V, Alloc> type;
+	};
+};
+//slot_map_btree_index is a counted b+tree with NodeBytes sized nodes, insert/erase are O(log n)
+template<size_t NodeBytes = 256>
+struct slot_map_btree_index {
+	template<typename V, typename Alloc>
+	struct rebind {
+		typedef slot_internal::btree_sequence<V, Alloc, NodeBytes> type;
+	};
+};
+
+}
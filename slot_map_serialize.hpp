@@ -0,0 +1,602 @@
+/*----------------------------------------------------------------------------------*\
+ |																					|
+ | slot_map_serialize.hpp 															|
+ |																					|
+ | Author: (C) Copyright Richard Cookman 2019										|
+ |																					|
+ | Permission is hereby granted, free of charge, to any person obtaining a copy		|
+ | of this software and associated documentation files (the "Software"), to deal	|
+ | in the Software without restriction, including without limitation the rights		|
+ | to use, copy, modify, merge, publish, distribute, sublicense, and/or sell		|
+ | copies of the Software, and to permit persons to whom the Software is			|
+ | furnished to do so, subject to the following conditions:							|
+ |																					|
+ | The above copyright notice and this permission notice shall be included in all	|
+ | copies or substantial portions of the Software.									|
+ |																					|
+ | THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR		|
+ | IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,			|
+ | FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE		|
+ | AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER			|
+ | LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,	|
+ | OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE	|
+ | SOFTWARE.																		|
+ |																					|
+\*----------------------------------------------------------------------------------*/
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "slot_map.hpp"
+
+namespace std {
+
+namespace slot_internal {
+
+//binary snapshot layout, native byte order and sizes so a file is read back by the same build of a program
+//header, a valid byte per slot, the current generation of each slot, then the objects
+//trivially copyable T: the slot contents (object or free list link) of every slot as one block
+//otherwise: the free list link of every slot as one block, then each object through the writer
+struct slot_map_file_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t tsize;									//sizeof(T), loading into a different T fails
+	uint64_t slots;
+	uint64_t count;
+	uint64_t firstslot;								//slots when the free list is empty
+	uint64_t lastslot;
+};
+
+//the slots changed since the last checkpoint, a map header followed by the number of changed slots
+//then for those slots: their index, valid byte, generation and the contents laid out as in a snapshot
+//when more than half the slots changed write_delta writes a full snapshot instead, the magic tells them apart
+struct slot_map_delta_header {
+	slot_map_file_header map;
+	uint64_t records;
+};
+
+struct slot_map_serializer {
+	static constexpr uint32_t version = 1;
+
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static void fill_header(slot_map<T, Mut, Alloc, MoonAlloc>& map, slot_map_file_header& hdr, const char* magic) {
+		size_t sze = map.items.size();
+		memcpy(hdr.magic, magic, 4);
+		hdr.version = version;
+		hdr.tsize = sizeof(T);
+		hdr.slots = sze;
+		hdr.count = map.count;
+		hdr.firstslot = map.firstslot ? std::distance(&map.items[0], map.firstslot) : sze;
+		hdr.lastslot = map.lastslot ? std::distance(&map.items[0], map.lastslot) : sze;
+	}
+	static bool check_header(const slot_map_file_header& hdr, size_t tsize, const char* magic) {
+		return memcmp(hdr.magic, magic, 4) == 0 && hdr.version == version && hdr.tsize == tsize && hdr.slots != 0 &&
+			   hdr.count <= hdr.slots && hdr.firstslot <= hdr.slots && hdr.lastslot <= hdr.slots;
+	}
+
+	//header, valid bytes and generations, called with the map locked
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static void save_slots(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map, std::vector<uint8_t>& valid) {
+		size_t sze = map.items.size();
+		slot_map_file_header hdr;
+		fill_header(map, hdr, "SLMP");
+
+		valid.assign(sze, 0);
+		std::vector<uint32_t> gens(sze, 0);
+		for(size_t i = 0; i < sze; ++i)
+			if(map.items[i].gens.is_valid()) {
+				valid[i] = 1;
+				gens[i] = map.items[i].gens.get_current_generation();
+			}
+		os.write((const char*)&hdr, sizeof(hdr));
+		os.write((const char*)valid.data(), sze * sizeof(uint8_t));
+		os.write((const char*)gens.data(), sze * sizeof(uint32_t));
+	}
+	//called with the map locked
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static bool save_bulk_internal(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+		typedef typename slot<T>::slot_data slot_data;
+		std::vector<uint8_t> valid;
+		save_slots(os, map, valid);
+
+		//the slot contents are contiguous apart from the generations, gather them into one block
+		size_t sze = map.items.size();
+		std::vector<slot_data> blk(sze);
+		for(size_t i = 0; i < sze; ++i)
+			memcpy((void*)&blk[i], (const void*)&map.items[i].unn, sizeof(slot_data));
+		os.write((const char*)blk.data(), sze * sizeof(slot_data));
+		//a full snapshot is a checkpoint, the next delta starts from here
+		map.clear_dirty();
+		return os.good();
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static bool save_bulk(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+		map.lock();
+		bool rtn = save_bulk_internal(os, map);
+		map.unlock();
+		return rtn;
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Write>
+	static bool save_objects_internal(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map, Write& wrt) {
+		std::vector<uint8_t> valid;
+		save_slots(os, map, valid);
+
+		size_t sze = map.items.size();
+		std::vector<uint64_t> nxt(sze, 0);
+		for(size_t i = 0; i < sze; ++i)
+			if(!valid[i])
+				nxt[i] = map.items[i].unn.next;
+		os.write((const char*)nxt.data(), sze * sizeof(uint64_t));
+		for(size_t i = 0; i < sze && os.good(); ++i)
+			if(valid[i])
+				wrt(os, *(const T*)map.items[i].unn.obj);
+		map.clear_dirty();
+		return os.good();
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Write>
+	static bool save_objects(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map, Write wrt) {
+		map.lock();
+		bool rtn = save_objects_internal(os, map, wrt);
+		map.unlock();
+		return rtn;
+	}
+
+	//the changed slots, called with the map locked
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static void dirty_slots(slot_map<T, Mut, Alloc, MoonAlloc>& map, std::vector<uint64_t>& idx) {
+		//whole words of unchanged slots are skipped, the cost follows the number of changes
+		idx.clear();
+		for(size_t w = 0; w < map.dirty.size(); ++w)
+			if(map.dirty[w] != 0)
+				for(size_t b = 0; b < 64; ++b)
+					if(map.dirty[w] & ((uint64_t)1 << b))
+						idx.push_back(w * 64 + b);
+	}
+	//past half the slots the indices cost more than the unchanged slots a snapshot would add
+	static bool delta_as_snapshot(size_t records, size_t slots) {
+		return records > slots / 2;
+	}
+
+	//delta header, indices, valid bytes and generations of the changed slots, called with the map locked
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static void save_delta_slots(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map, const std::vector<uint64_t>& idx, std::vector<uint8_t>& valid) {
+		slot_map_delta_header hdr;
+		fill_header(map, hdr.map, "SLMD");
+		hdr.records = idx.size();
+
+		valid.assign(idx.size(), 0);
+		std::vector<uint32_t> gens(idx.size(), 0);
+		for(size_t i = 0; i < idx.size(); ++i)
+			if(map.items[idx[i]].gens.is_valid()) {
+				valid[i] = 1;
+				gens[i] = map.items[idx[i]].gens.get_current_generation();
+			}
+		os.write((const char*)&hdr, sizeof(hdr));
+		os.write((const char*)idx.data(), idx.size() * sizeof(uint64_t));
+		os.write((const char*)valid.data(), idx.size() * sizeof(uint8_t));
+		os.write((const char*)gens.data(), idx.size() * sizeof(uint32_t));
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static bool save_delta_bulk(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+		typedef typename slot<T>::slot_data slot_data;
+		map.lock();
+		std::vector<uint64_t> idx;
+		dirty_slots(map, idx);
+		if(delta_as_snapshot(idx.size(), map.items.size())) {
+			bool rtn = save_bulk_internal(os, map);
+			map.unlock();
+			return rtn;
+		}
+		std::vector<uint8_t> valid;
+		save_delta_slots(os, map, idx, valid);
+
+		std::vector<slot_data> blk(idx.size());
+		for(size_t i = 0; i < idx.size(); ++i)
+			memcpy((void*)&blk[i], (const void*)&map.items[idx[i]].unn, sizeof(slot_data));
+		os.write((const char*)blk.data(), idx.size() * sizeof(slot_data));
+		map.clear_dirty();
+		map.unlock();
+		return os.good();
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Write>
+	static bool save_delta_objects(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map, Write wrt) {
+		map.lock();
+		std::vector<uint64_t> idx;
+		dirty_slots(map, idx);
+		if(delta_as_snapshot(idx.size(), map.items.size())) {
+			bool rtn = save_objects_internal(os, map, wrt);
+			map.unlock();
+			return rtn;
+		}
+		std::vector<uint8_t> valid;
+		save_delta_slots(os, map, idx, valid);
+
+		std::vector<uint64_t> nxt(idx.size(), 0);
+		for(size_t i = 0; i < idx.size(); ++i)
+			if(!valid[i])
+				nxt[i] = map.items[idx[i]].unn.next;
+		os.write((const char*)nxt.data(), idx.size() * sizeof(uint64_t));
+		for(size_t i = 0; i < idx.size() && os.good(); ++i)
+			if(valid[i])
+				wrt(os, *(const T*)map.items[idx[i]].unn.obj);
+		map.clear_dirty();
+		map.unlock();
+		return os.good();
+	}
+
+	//read and check everything before the objects after the header, the map isn't touched yet
+	static bool load_slots(std::istream& is, const slot_map_file_header& hdr, std::vector<uint8_t>& valid, std::vector<uint32_t>& gens) {
+		valid.resize(hdr.slots);
+		gens.resize(hdr.slots);
+		if(!is.read((char*)valid.data(), hdr.slots * sizeof(uint8_t)) || !is.read((char*)gens.data(), hdr.slots * sizeof(uint32_t)))
+			return false;
+		size_t cnt = 0;
+		for(size_t i = 0; i < valid.size(); ++i)
+			cnt += valid[i] ? 1 : 0;
+		return cnt == hdr.count;
+	}
+	//empty the map (handles to the old contents become invalid, like a move assignment over it) and size it, returns locked
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static void begin_load(slot_map<T, Mut, Alloc, MoonAlloc>& map, size_t sze) {
+		map.reset(false, false);
+		map.lock();
+		map.items.clear();
+		map.items.resize(sze);
+		memset((void*)&map.items[0], 0, sizeof(slot<T>) * sze);
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static void end_load(slot_map<T, Mut, Alloc, MoonAlloc>& map, const slot_map_file_header& hdr) {
+		size_t sze = map.items.size();
+		map.count = hdr.count;
+		map.firstslot = hdr.firstslot < sze ? &map.items[hdr.firstslot] : 0;
+		map.lastslot = hdr.lastslot < sze ? &map.items[hdr.lastslot] : 0;
+		//the map matches the snapshot, that is the checkpoint for the next delta
+		map.dirty.assign((sze + 63) / 64, 0);
+		map.unlock();
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static bool load_bulk(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map, const slot_map_file_header& hdr) {
+		typedef typename slot<T>::slot_data slot_data;
+		std::vector<uint8_t> valid;
+		std::vector<uint32_t> gens;
+		if(!load_slots(is, hdr, valid, gens))
+			return false;
+		std::vector<slot_data> blk(hdr.slots);
+		if(!is.read((char*)blk.data(), hdr.slots * sizeof(slot_data)))
+			return false;
+
+		begin_load(map, hdr.slots);
+		for(size_t i = 0; i < hdr.slots; ++i) {
+			memcpy((void*)&map.items[i].unn, (const void*)&blk[i], sizeof(slot_data));
+			//the saved generations are current again, no handle counts until handles are loaded
+			if(valid[i])
+				map.items[i].gens.restore_generation(gens[i]);
+		}
+		end_load(map, hdr);
+		return true;
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static bool load_bulk(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+		slot_map_file_header hdr;
+		if(!is.read((char*)&hdr, sizeof(hdr)) || !check_header(hdr, sizeof(T), "SLMP"))
+			return false;
+		return load_bulk(is, map, hdr);
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Read>
+	static bool load_objects(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map, const slot_map_file_header& hdr, Read& rd) {
+		std::vector<uint8_t> valid;
+		std::vector<uint32_t> gens;
+		if(!load_slots(is, hdr, valid, gens))
+			return false;
+		std::vector<uint64_t> nxt(hdr.slots);
+		if(!is.read((char*)nxt.data(), hdr.slots * sizeof(uint64_t)))
+			return false;
+
+		begin_load(map, hdr.slots);
+		for(size_t i = 0; i < hdr.slots; ++i) {
+			if(!valid[i]) {
+				map.items[i].unn.next = nxt[i];
+				continue;
+			}
+			new (map.items[i].unn.obj) T(rd(is));
+			map.items[i].gens.restore_generation(gens[i]);
+			if(!is.good()) {
+				//destroys the objects read so far and leaves an empty usable map
+				map.unlock();
+				map.reset(false, false);
+				return false;
+			}
+		}
+		end_load(map, hdr);
+		return true;
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Read>
+	static bool load_objects(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map, Read rd) {
+		slot_map_file_header hdr;
+		if(!is.read((char*)&hdr, sizeof(hdr)) || !check_header(hdr, sizeof(T), "SLMP"))
+			return false;
+		return load_objects(is, map, hdr, rd);
+	}
+
+	//a delta starts with the map header, "SLMP" if it is a full snapshot and is loaded as one
+	//returns 0 on a bad stream, 1 for a delta and 2 for a snapshot
+	static int read_delta_header(std::istream& is, size_t tsize, slot_map_delta_header& hdr) {
+		if(!is.read((char*)&hdr.map, sizeof(hdr.map)))
+			return 0;
+		if(check_header(hdr.map, tsize, "SLMP"))
+			return 2;
+		if(!check_header(hdr.map, tsize, "SLMD") || !is.read((char*)&hdr.records, sizeof(hdr.records)))
+			return 0;
+		return 1;
+	}
+	//a snapshot written by write_delta, every slot counts as changed as with a delta that touched them all
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static void end_apply_snapshot(slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+		map.lock();
+		map.set_dirty(0, map.items.size());
+		map.unlock();
+	}
+
+	//read and check everything before the contents after the header, the map isn't touched yet
+	static bool load_delta_slots(std::istream& is, slot_map_delta_header& hdr, std::vector<uint64_t>& idx,
+								 std::vector<uint8_t>& valid, std::vector<uint32_t>& gens) {
+		if(hdr.records > hdr.map.slots)
+			return false;
+		idx.resize(hdr.records);
+		valid.resize(hdr.records);
+		gens.resize(hdr.records);
+		if(!is.read((char*)idx.data(), hdr.records * sizeof(uint64_t)) || !is.read((char*)valid.data(), hdr.records * sizeof(uint8_t)) ||
+		   !is.read((char*)gens.data(), hdr.records * sizeof(uint32_t)))
+			return false;
+		for(size_t i = 0; i < idx.size(); ++i)
+			if(idx[i] >= hdr.map.slots)
+				return false;
+		return true;
+	}
+	//check the delta follows on from the map (the object count comes out right) and size the map, returns locked
+	//handles into the map are dropped as with a load, their counts are cleared out of the generations
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static bool begin_apply(slot_map<T, Mut, Alloc, MoonAlloc>& map, const slot_map_delta_header& hdr,
+							const std::vector<uint64_t>& idx, const std::vector<uint8_t>& valid) {
+		size_t sze = hdr.map.slots;
+		map.lock();
+		size_t csze = map.items.size();
+		size_t cnt = map.count;
+		for(size_t i = sze; i < csze; ++i)
+			if(map.items[i].gens.is_valid())
+				--cnt;
+		for(size_t i = 0; i < idx.size(); ++i) {
+			if(idx[i] < csze && map.items[idx[i]].gens.is_valid())
+				--cnt;
+			if(valid[i])
+				++cnt;
+		}
+		bool hdls = map.moon->count != 0;
+		map.unlock();
+		if(cnt != hdr.map.count)
+			return false;
+
+		if(hdls)
+			map.orphanMoon();
+		map.lock();
+		if(hdls)
+			for(auto it = map.items.begin(); it != map.items.end(); ++it)
+				if(it->gens.is_valid())
+					it->gens.restore_generation(it->gens.get_current_generation());
+
+		//a clear (move or copy assignment) of the source can make the map smaller
+		for(size_t i = sze; i < csze; ++i)
+			if(map.items[i].gens.is_valid())
+				((T*)map.items[i].unn.obj)->~T();
+		if(sze < csze)
+			map.items.erase(map.items.begin() + sze, map.items.end());
+		else if(sze > csze) {
+			map.items.resize(sze);
+			memset((void*)&map.items[csze], 0, sizeof(slot<T>) * (sze - csze));
+		}
+		map.dirty.resize((sze + 63) / 64, 0);
+		if(sze % 64 != 0)
+			map.dirty.back() &= ((uint64_t)1 << (sze % 64)) - 1;
+
+		//the changed slots are emptied, the contents go in next
+		for(size_t i = 0; i < idx.size(); ++i) {
+			slot<T>& rf = map.items[idx[i]];
+			if(rf.gens.is_valid()) {
+				((T*)rf.unn.obj)->~T();
+				rf.gens.set_invalid();
+			}
+			map.set_dirty(idx[i]);
+		}
+		return true;
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static void end_apply(slot_map<T, Mut, Alloc, MoonAlloc>& map, const slot_map_delta_header& hdr) {
+		size_t sze = map.items.size();
+		map.count = hdr.map.count;
+		map.firstslot = hdr.map.firstslot < sze ? &map.items[hdr.map.firstslot] : 0;
+		map.lastslot = hdr.map.lastslot < sze ? &map.items[hdr.map.lastslot] : 0;
+		map.unlock();
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static bool apply_bulk(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+		typedef typename slot<T>::slot_data slot_data;
+		slot_map_delta_header hdr;
+		int kind = read_delta_header(is, sizeof(T), hdr);
+		if(kind == 2) {
+			if(!load_bulk(is, map, hdr.map))
+				return false;
+			end_apply_snapshot(map);
+			return true;
+		}
+		std::vector<uint64_t> idx;
+		std::vector<uint8_t> valid;
+		std::vector<uint32_t> gens;
+		if(kind == 0 || !load_delta_slots(is, hdr, idx, valid, gens))
+			return false;
+		std::vector<slot_data> blk(hdr.records);
+		if(!is.read((char*)blk.data(), hdr.records * sizeof(slot_data)))
+			return false;
+
+		if(!begin_apply(map, hdr, idx, valid))
+			return false;
+		for(size_t i = 0; i < idx.size(); ++i) {
+			slot<T>& rf = map.items[idx[i]];
+			memcpy((void*)&rf.unn, (const void*)&blk[i], sizeof(slot_data));
+			if(valid[i])
+				rf.gens.restore_generation(gens[i]);
+		}
+		end_apply(map, hdr);
+		return true;
+	}
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Read>
+	static bool apply_objects(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map, Read rd) {
+		slot_map_delta_header hdr;
+		int kind = read_delta_header(is, sizeof(T), hdr);
+		if(kind == 2) {
+			if(!load_objects(is, map, hdr.map, rd))
+				return false;
+			end_apply_snapshot(map);
+			return true;
+		}
+		std::vector<uint64_t> idx;
+		std::vector<uint8_t> valid;
+		std::vector<uint32_t> gens;
+		if(kind == 0 || !load_delta_slots(is, hdr, idx, valid, gens))
+			return false;
+		std::vector<uint64_t> nxt(hdr.records);
+		if(!is.read((char*)nxt.data(), hdr.records * sizeof(uint64_t)))
+			return false;
+
+		if(!begin_apply(map, hdr, idx, valid))
+			return false;
+		for(size_t i = 0; i < idx.size(); ++i) {
+			slot<T>& rf = map.items[idx[i]];
+			if(!valid[i]) {
+				rf.unn.next = nxt[i];
+				continue;
+			}
+			new (rf.unn.obj) T(rd(is));
+			rf.gens.restore_generation(gens[i]);
+			if(!is.good()) {
+				//half a delta is no state of the source, leave an empty usable map
+				map.unlock();
+				map.reset(false, false);
+				return false;
+			}
+		}
+		end_apply(map, hdr);
+		return true;
+	}
+
+	template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+	static bool load_handle(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map, internal_slot_map_handle<Mut>& hdl, bool weak) {
+		uint64_t rd[2];
+		if(!is.read((char*)rd, sizeof(rd)))
+			return false;
+		map.lock();
+		bool rtn = false;
+		if(rd[0] < map.items.size()) {
+			slot<T>& rf = map.items[rd[0]];
+			if(rf.gens.is_valid() && rf.gens.match_generation(rd[1], weak)) {
+				auto& cnt = rf.gens.get_generation_count(rd[1]);
+				if(weak)
+					++cnt.weakcount;
+				else
+					++cnt.strongcount;
+				++map.moon->count;
+				hdl.moon = map.moon;
+				hdl.idx = rd[0];
+				hdl.gen = rd[1];
+				rtn = true;
+			}
+		}
+		map.unlock();
+		return rtn;
+	}
+};
+
+}
+
+//write the map to os, T must be trivially copyable, the objects are written as one block
+//this is also a checkpoint, the next write_delta only has the slots changed after it
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+inline bool save(std::ostream& os, const slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+	static_assert(std::is_trivially_copyable<T>::value, "save(os, map, wrt) with a writer for T that isn't trivially copyable");
+	return slot_internal::slot_map_serializer::save_bulk(os, const_cast<slot_map<T, Mut, Alloc, MoonAlloc>&>(map));
+}
+//wrt(std::ostream&, const T&) writes one object
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Write>
+inline bool save(std::ostream& os, const slot_map<T, Mut, Alloc, MoonAlloc>& map, Write wrt) {
+	return slot_internal::slot_map_serializer::save_objects(os, const_cast<slot_map<T, Mut, Alloc, MoonAlloc>&>(map), wrt);
+}
+
+//replace the contents of map with a saved map, every object keeps its slot and generation so saved handles resolve
+//handles to the old contents become invalid. A loaded object isn't counted by any handle until its handles are loaded,
+//objects nothing loads a handle for live until erased or cleared. Returns false on a bad stream, the map is left as it was
+//unless the failure was in reading the objects, then it is left empty
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+inline bool load(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+	static_assert(std::is_trivially_copyable<T>::value, "load(is, map, rd) with a reader for T that isn't trivially copyable");
+	return slot_internal::slot_map_serializer::load_bulk(is, map);
+}
+//rd(std::istream&) reads one object and returns it
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Read>
+inline bool load(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map, Read rd) {
+	return slot_internal::slot_map_serializer::load_objects(is, map, rd);
+}
+
+//write the slots changed since the last checkpoint (save or write_delta) and make this the checkpoint
+//inserts, erases, modify(handle, fn) and non-const access (handle dereference, get_object, iterators) change a slot,
+//reads through a const handle, the const get_object or const iterators don't. Writes through a pointer kept from before
+//the checkpoint aren't seen, get it again or mark_dirty the slot. When more than half the slots changed a full snapshot
+//is written
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+inline bool write_delta(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+	static_assert(std::is_trivially_copyable<T>::value, "write_delta(os, map, wrt) with a writer for T that isn't trivially copyable");
+	return slot_internal::slot_map_serializer::save_delta_bulk(os, map);
+}
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Write>
+inline bool write_delta(std::ostream& os, slot_map<T, Mut, Alloc, MoonAlloc>& map, Write wrt) {
+	return slot_internal::slot_map_serializer::save_delta_objects(os, map, wrt);
+}
+
+//replay a delta onto a map holding the state of the checkpoint it was written after (the snapshot and each delta before
+//it, applied in order), objects keep their slots and generations as with load and handles into the map become invalid
+//(load them again). A snapshot written by write_delta replaces the map as load does. Returns false with the map left as
+//it was on a bad stream or a delta that doesn't follow on from the map, unless the failure was in reading the objects,
+//then the map is left empty
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+inline bool apply_delta(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map) {
+	static_assert(std::is_trivially_copyable<T>::value, "apply_delta(is, map, rd) with a reader for T that isn't trivially copyable");
+	return slot_internal::slot_map_serializer::apply_bulk(is, map);
+}
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc, typename Read>
+inline bool apply_delta(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map, Read rd) {
+	return slot_internal::slot_map_serializer::apply_objects(is, map, rd);
+}
+
+//a handle is its slot index and generation, an invalid handle is written as one no slot has
+template<typename Mut>
+inline bool save_handle(std::ostream& os, const slot_internal::internal_slot_map_handle<Mut>& hdl) {
+	uint64_t wr[2] = {hdl.moon ? (uint64_t)hdl.idx : (uint64_t)-1, (uint64_t)hdl.gen};
+	os.write((const char*)wr, sizeof(wr));
+	return os.good();
+}
+//point hdl at the object it referenced when saved, false if the object is gone or from another map (hdl is left empty)
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+inline bool load_handle(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map, slot_map_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	hdl = slot_map_handle<T, Mut, Alloc, MoonAlloc>();
+	return slot_internal::slot_map_serializer::load_handle(is, map, hdl, false);
+}
+template<typename T, typename Mut, typename Alloc, typename MoonAlloc>
+inline bool load_handle(std::istream& is, slot_map<T, Mut, Alloc, MoonAlloc>& map, slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>& hdl) {
+	hdl = slot_map_weak_handle<T, Mut, Alloc, MoonAlloc>();
+	return slot_internal::slot_map_serializer::load_handle(is, map, hdl, true);
+}
+
+}